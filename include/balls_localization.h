@@ -4,10 +4,17 @@
 #define BALLS_LOCALIZATION_H
 
 #include "playing_field_localization.h"
+#include "frame_context.h"
+#include "hsv_band_classifier.h"
+#include "segmentation.h"
+#include "circle_grid.h"
+#include "circle_filter_cascade.h"
 
 #include <opencv2/imgproc.hpp>
 #include <opencv2/highgui.hpp>
 
+#include <map>
+
 /**
  * @brief Structure to hold the localization information of a single ball.
  */
@@ -46,6 +53,65 @@ struct balls_localization
 };
 typedef struct balls_localization balls_localization;
 
+/**
+ * @brief Maps a balls localization from the working resolution of a frame to its source resolution.
+ *
+ * @param localization The localization at the working resolution.
+ * @param resolution The resolution of the frame.
+ * @param dst The output localization at the source resolution.
+ */
+void map_to_source(const balls_localization &localization, const frame_resolution &resolution, balls_localization &dst);
+
+/**
+ * @brief Structure to hold the classification features of a circle, extracted in a single pass over its pixels.
+ *
+ * Only the pixels of the circle which do not belong to the playing field segmentation are considered.
+ */
+struct ball_features
+{
+    int valid_pixels;        // Number of pixels of the circle not belonging to the playing field.
+    int cue_white_pixels;    // Number of pixels within the cue ball white HSV range.
+    int stripe_white_pixels; // Number of pixels within the stripe white HSV range, small components excluded.
+    int black_pixels;        // Number of pixels within the black HSV range.
+    float mean_hue;          // Mean hue of the pixels.
+};
+typedef struct ball_features ball_features;
+
+/**
+ * @enum candidate_generator
+ * @brief Enum representing the backend generating the candidate circles of the balls.
+ *
+ * @var hough_generator Hough transform of the segmentation mask.
+ * @var distance_transform_generator Local maxima of the distance transform of the blobs out of the segmentation mask.
+ */
+enum candidate_generator
+{
+    hough_generator,
+    distance_transform_generator
+};
+
+/**
+ * @struct balls_localizer_options
+ * @brief Struct representing the options of the balls localizer.
+ *
+ * @var generator The backend generating the candidate circles.
+ * @var pyramid_levels The number of halvings of the resolution at which the candidates are found, 0 for full resolution.
+ * @var crop_to_table Whether every stage works on the box of the table only, mapping the results back to the frame.
+ * @var rectify_table Whether every stage works on a fixed size top-down image of the table, warped by the table homography,
+ * mapping the results back to the frame with its inverse. Cropping is ignored when rectifying.
+ * @var filters_order The order of the circle filters independent from each other, "out_of_bound", "near_holes" and
+ * "empty", the unnamed ones running after them. The filter of close dissimilar circles, "close_dissimilar", always runs last.
+ */
+struct balls_localizer_options
+{
+    candidate_generator generator = hough_generator;
+    int pyramid_levels = 0;
+    bool crop_to_table = false;
+    bool rectify_table = false;
+    std::vector<std::string> filters_order;
+};
+typedef struct balls_localizer_options balls_localizer_options;
+
 /**
  * @brief Class for localizing balls on a playing field.
  */
@@ -56,9 +122,18 @@ public:
      * @brief Constructor for balls_localizer.
      *
      * @param localization The localization of the playing field.
+     * @param options The options of the localizer.
+     */
+    balls_localizer(const playing_field_localization &localization, const balls_localizer_options &options = balls_localizer_options());
+
+    /**
+     * @brief Sets the localization of the playing field of the next frames, so that the localizer, with its
+     * buffers, is reused across frames.
+     *
+     * @param localization The localization of the playing field.
      */
-    balls_localizer(const playing_field_localization &localization)
-        : playing_field{localization} {};
+    void set_playing_field(const playing_field_localization &localization);
+
     /**
      * Localize the balls.
      *
@@ -66,6 +141,14 @@ public:
      */
     void localize(const cv::Mat &src);
 
+    /**
+     * Localize the balls, sharing the frame representations through the given context.
+     * The playing field localization and the balls one refer to the working resolution of the frame.
+     *
+     * @param context The context of the input frame.
+     */
+    void localize(frame_context &context);
+
     /**
      * Returns the bounding boxes of all detected balls.
      *
@@ -80,43 +163,212 @@ public:
      */
     balls_localization get_localization() { return localization; }
 
+    /**
+     * Returns the statistics of the circle filters of the last localization, in the order the filters ran.
+     *
+     * @return the statistics of the circle filters.
+     */
+    const std::vector<circle_filter_statistics> &get_filters_statistics() const { return filters_statistics; }
+
 private:
     /**
-     * @brief Generates binary masks for each circle in the input vector.
+     * Localize the balls on the processed image of the table, mapping the circles back to the frame before
+     * classifying them.
+     *
+     * @param context The context of the processed image, either a box of the frame or the rectified table.
+     */
+    void localize_table(frame_context &context);
+
+    /**
+     * @brief Maps circles from the processed image of the table to the frame.
+     *
+     * Circles of a box of the frame are translated. Circles of the rectified table have their centers projected by
+     * the inverse of the rectification, and their radii divided by the length in the rectified table of a frame
+     * pixel along the row of the projected center.
+     *
+     * @param circles The circles to map, each represented by a Vec3f (x, y, radius).
+     */
+    void map_circles_to_frame(std::vector<cv::Vec3f> &circles);
+
+    /**
+     * @brief Returns the filled disk stencil of a given integer radius.
+     *
+     * The stencil is a (2 * radius + 1) square binary mask with the disk centered in it. Stencils are
+     * computed once and cached, so that per-circle operations work on the circle patch only.
+     *
+     * @param radius The radius of the disk.
+     * @return The stencil of the disk.
+     */
+    const cv::Mat &get_disk_stencil(int radius);
+
+    /**
+     * @brief Computes the patch of a circle clipped to the image bounds.
+     *
+     * @param center The integer center of the circle.
+     * @param radius The integer radius of the circle.
+     * @param image_size The size of the image containing the circle.
+     * @param image_roi Output region of the image covered by the circle.
+     * @param stencil_roi Output region of the disk stencil corresponding to image_roi.
+     * @return true if the circle patch is not empty, false otherwise.
+     */
+    bool get_circle_patch(cv::Point center, int radius, cv::Size image_size, cv::Rect &image_roi, cv::Rect &stencil_roi);
+
+    /**
+     * @brief Segments the balls out of the playing field.
+     *
+     * Pixels are classified by the bands of the board color, widened with the shadow and color bands near the
+     * cushions, then the field regions are grown and the mask is cleaned up. The frame may be downsampled, in which
+     * case the cushion distance is sampled at its resolution keeping full resolution values.
+     *
+     * @param blurred_masked_hsv The blurred HSV frame, masked by the playing field.
+     * @param cushion_distance The cushion distance of the pixels of the frame, in full resolution pixels.
+     * @param board_color_hsv The HSV color of the board.
+     * @param scale The downsampling factor of the frame from the full resolution one.
+     * @param merge_corner Whether the background component containing the top left corner is merged into the mask.
+     * @param dst Output segmentation mask, where balls are black.
+     */
+    void segment_balls(const cv::Mat &blurred_masked_hsv, const cv::Mat &cushion_distance, const cv::Vec3b &board_color_hsv, int scale, bool merge_corner, cv::Mat &dst);
+
+    /**
+     * @brief Finds the candidate circles of the balls on a level of the pyramid of the frame, then refines them at full
+     * resolution.
+     *
+     * The masks and the candidates are computed on the downsampled frame. Each candidate is then segmented again at full
+     * resolution within a window around it, where its center is moved to the deepest pixel of its blob near the coarse
+     * center and its radius is set to the depth of that pixel. The outputs are full resolution images holding the
+     * windows only, which is all the circle filters and the features extraction look at.
+     *
+     * @param context The context of the input frame.
+     * @param min_radius The minimum radius of the balls at full resolution.
+     * @param max_radius The maximum radius of the balls at full resolution.
+     * @param min_distance The minimum distance between the centers of the balls at full resolution.
+     * @param blurred_masked_hsv Output blurred HSV frame, masked by the playing field, within the windows.
+     * @param src_masked_hsv Output HSV frame, masked by the playing field, within the windows.
+     * @param segmentation_mask Output segmentation mask, where balls are black, within the windows.
+     * @param circles Output refined circles, each represented by a Vec3f (x, y, radius).
+     */
+    void localize_coarse_to_fine(frame_context &context, int min_radius, int max_radius, int min_distance, cv::Mat &blurred_masked_hsv, cv::Mat &src_masked_hsv, cv::Mat &segmentation_mask, std::vector<cv::Vec3f> &circles);
+
+    /**
+     * @brief Generates the candidate circles of the balls with the backend selected by the options.
+     *
+     * @param segmentation_mask The segmentation mask, where balls are black.
+     * @param min_radius The minimum radius of the circles.
+     * @param max_radius The maximum radius of the circles.
+     * @param min_distance The minimum distance between the centers of the circles.
+     * @param scale The downsampling factor of the segmentation mask from the full resolution frame.
+     * @param circles Output circles, each represented by a Vec3f (x, y, radius).
+     */
+    void generate_candidates(const cv::Mat &segmentation_mask, int min_radius, int max_radius, int min_distance, int scale, std::vector<cv::Vec3f> &circles);
+
+    /**
+     * @brief Gets the band of radii in which balls centered between two image rows are searched.
+     *
+     * The band widens the range of the radii expected by the perspective of the playing field over the rows by a
+     * quarter, to account for partially visible balls and errors of the corners. It is always within the given radius range,
+     * which is returned as it is when the playing field has no radius model.
+     *
+     * @param first_row The first row of the centers.
+     * @param last_row The last row of the centers, included.
+     * @param min_radius The minimum radius of the balls in the whole frame.
+     * @param max_radius The maximum radius of the balls in the whole frame.
+     * @param scale The downsampling factor of the rows and radii from the full resolution frame.
+     * @param band_min The output minimum radius of the band.
+     * @param band_max The output maximum radius of the band.
+     */
+    void get_ball_radius_band(int first_row, int last_row, int min_radius, int max_radius, int scale, int &band_min, int &band_max);
+
+    /**
+     * @brief Generates the candidate circles with the Hough transform of the segmentation mask.
+     *
+     * The whole frame is searched once within the radius band of all its rows, then the circles whose radius is out
+     * of the band of their row are discarded as candidates of the wrong size.
+     *
+     * @param segmentation_mask The segmentation mask, where balls are black.
+     * @param min_radius The minimum radius of the circles.
+     * @param max_radius The maximum radius of the circles.
+     * @param min_distance The minimum distance between the centers of the circles.
+     * @param scale The downsampling factor of the segmentation mask from the full resolution frame.
+     * @param circles Output circles, each represented by a Vec3f (x, y, radius).
+     */
+    void generate_hough_candidates(const cv::Mat &segmentation_mask, int min_radius, int max_radius, int min_distance, int scale, std::vector<cv::Vec3f> &circles);
+
+    /**
+     * @brief Generates the candidate circles with the distance transform of the blobs out of the segmentation mask.
+     *
+     * The distance of the center of a ball blob from the playing field is its radius, so the local maxima of the
+     * distance within the radius band of their row are taken as circles, the deepest first, suppressing the ones
+     * closer than min_distance to a circle already taken. The cost is linear in the number of pixels.
+     *
+     * @param segmentation_mask The segmentation mask, where balls are black.
+     * @param min_radius The minimum radius of the circles.
+     * @param max_radius The maximum radius of the circles.
+     * @param min_distance The minimum distance between the centers of the circles.
+     * @param scale The downsampling factor of the segmentation mask from the full resolution frame.
+     * @param circles Output circles, each represented by a Vec3f (x, y, radius).
+     */
+    void generate_distance_transform_candidates(const cv::Mat &segmentation_mask, int min_radius, int max_radius, int min_distance, int scale, std::vector<cv::Vec3f> &circles);
+
+    /**
+     * @brief Computes, for each row, the spans of the playing field deeper than the given depth from the table edges.
+     *
+     * The spans are the ones of the field mask eroded with a MORPH_CROSS element of size depth x depth, obtained by
+     * thresholding the cushion distance of the field. Odd depths are rounded up to the next even one.
      *
-     * @param circles A vector of circles for which masks are generated.
-     * @param masks A vector to store the generated masks.
-     * @param mask_size The size of each mask.
+     * @param cushion_distance The cushion distance of the playing field.
+     * @param depth The depth from the table edges.
+     * @param shrinked_spans Output column ranges of the shrinked field for each row.
+     */
+    void get_shrinked_field_spans(const cv::Mat &cushion_distance, int depth, std::vector<std::vector<cv::Range>> &shrinked_spans);
+
+    /**
+     * @brief Classifies the pixels of the playing field by their depth from the table edges.
+     *
+     * Each span of a row is classified once with the classifier of its cushion band, so that bands restricted
+     * to the table edges are never evaluated on the table interior.
+     *
+     * @param hsv The input image in HSV color space.
+     * @param interior_classifier The classifier of the pixels deeper than both bands.
+     * @param shadow_band_classifier The classifier of the pixels within the shadow band only.
+     * @param color_band_classifier The classifier of the pixels within the color band, which lies within the shadow band.
+     * @param shadow_shrinked_spans The spans of the field not belonging to the shadow band, for each row.
+     * @param color_shrinked_spans The spans of the field not belonging to the color band, for each row.
+     * @param dst The output binary mask.
      */
-    void circles_masks(const std::vector<cv::Vec3f> &circles, std::vector<cv::Mat> &masks, cv::Size mask_size);
+    void classify_by_cushion_band(const cv::Mat &hsv, const hsv_band_classifier &interior_classifier, const hsv_band_classifier &shadow_band_classifier, const hsv_band_classifier &color_band_classifier, const std::vector<std::vector<cv::Range>> &shadow_shrinked_spans, const std::vector<std::vector<cv::Range>> &color_shrinked_spans, cv::Mat &dst);
 
     /**
-     * @brief Filters out circles that do not significantly intersect with a given segmentation mask.
+     * @brief Rejects circles that do not significantly intersect with a given segmentation mask.
      *
      * @param circles A vector of circles to filter.
-     * @param masks Binary masks corresponding to the circles.
      * @param segmentation_mask The segmentation mask to check intersection with.
      * @param intersection_threshold The minimum intersection ratio required to keep a circle.
+     * @param rejected Flags of the rejected circles, updated with the empty circles.
      */
-    void filter_empty_circles(std::vector<cv::Vec3f> &circles, const std::vector<cv::Mat> &masks, const cv::Mat &segmentation_mask, float intersection_threshold);
+    void filter_empty_circles(const std::vector<cv::Vec3f> &circles, const cv::Mat &segmentation_mask, float intersection_threshold, std::vector<bool> &rejected);
 
     /**
-     * @brief Filters out circles that are outside a specified table mask.
+     * @brief Rejects circles whose center is not deep enough within the table.
      *
      * @param circles A vector of circles to filter.
-     * @param table_mask A mask representing the valid area for circles.
-     * @param distance_threshold Erosion distance for the table mask.
+     * @param cushion_distance The cushion distance of the playing field.
+     * @param distance_threshold Erosion distance for the table mask, rounded up to an even one.
+     * @param rejected Flags of the rejected circles, updated with the out of bound circles.
      */
-    void filter_out_of_bound_circles(std::vector<cv::Vec3f> &circles, const cv::Mat &table_mask, int distance_threshold);
+    void filter_out_of_bound_circles(const std::vector<cv::Vec3f> &circles, const cv::Mat &cushion_distance, int distance_threshold, std::vector<bool> &rejected);
 
     /**
-     * @brief Filters out circles that are too close to specified holes.
+     * @brief Rejects circles that are too close to specified holes.
+     *
+     * Only the circles indexed near each hole by the grid are visited.
      *
      * @param circles A vector of circles to filter.
+     * @param grid The grid indexing the circles.
      * @param holes_points A vector of points representing holes.
      * @param distance_threshold Minimum distance a circle must be from a hole to be kept.
+     * @param rejected Flags of the rejected circles, updated with the circles close to a hole.
      */
-    void filter_near_holes_circles(std::vector<cv::Vec3f> &circles, const std::vector<cv::Point> &holes_points, float distance_threshold);
+    void filter_near_holes_circles(const std::vector<cv::Vec3f> &circles, const circle_grid &grid, const std::vector<cv::Point> &holes_points, float distance_threshold, std::vector<bool> &rejected);
 
     /**
      * @brief Extracts bounding boxes for each circle.
@@ -138,56 +390,65 @@ private:
     cv::Rect get_bounding_box(cv::Vec3f circle);
 
     /**
-     * @brief Fills small holes in a binary mask.
+     * @brief Cleans up a binary mask with a single labeling of its background.
+     *
+     * The mask is closed, then the holes whose contour encloses an area smaller than the threshold are filled and,
+     * if requested, the background component containing the top left corner is merged into the mask. The corner of a
+     * whole frame is off the field, while the corner of a window around a ball may belong to a ball. The contour of
+     * each hole is traced within a small neighborhood of its bounding box, giving the same area as the contour
+     * traced on the whole mask.
      *
      * @param binary_mask The binary mask to process.
+     * @param closure_size The size of the elliptic structuring element of the closing.
      * @param area_threshold Maximum area of holes to fill.
+     * @param merge_corner Whether the background component containing the top left corner is merged into the mask.
      */
-    void fill_small_holes(cv::Mat &binary_mask, double area_threshold);
+    void clean_up_segmentation_mask(cv::Mat &binary_mask, cv::Size closure_size, double area_threshold, bool merge_corner);
 
     /**
-     * @brief Extracts seed points from a given binary mask.
+     * @brief Extracts the classification features of each circle.
+     *
+     * The pixels of each circle patch are visited once, intersecting the circle with the negated segmentation mask.
+     * Cue white, black and mean hue features are computed on the blurred image, stripe white features on the
+     * source image, as the stripes are thin and would be smoothed out by the blurring.
      *
-     * @param inrange_segmentation_mask Binary mask to extract seed points from.
-     * @param seed_points A vector to store the extracted seed points.
+     * @param blurred_hsv The blurred source image in HSV color space.
+     * @param src_hsv The source image in HSV color space.
+     * @param segmentation_mask The segmentation mask used to exclude the playing field areas.
+     * @param circles A vector containing the circles, where each circle is represented by a Vec3f (x, y, radius).
+     * @param features Output vector of the features of each circle.
      */
-    void extract_seed_points(const cv::Mat &inrange_segmentation_mask, std::vector<cv::Point> &seed_points);
+    void extract_ball_features(const cv::Mat &blurred_hsv, const cv::Mat &src_hsv, const cv::Mat &segmentation_mask, const std::vector<cv::Vec3f> &circles, std::vector<ball_features> &features);
 
     /**
-     * @brief Computes the ratio of white pixels within a specified circle on the source image for looking for the cue ball.
-     *
-     * This function calculates the ratio of white pixels within a given circle, intersected with the provided segmentation mask.
-     * It uses a specific range in the HSV color space to determine the white pixels.
+     * @brief Computes the ratio of white pixels within a circle for looking for the cue ball.
      *
-     * @param src The source image in HSV color space.
-     * @param segmentation_mask The segmentation mask used to exclude certain areas.
-     * @param circle A Vec3f representing a circle (x, y, radius) where the calculation is performed.
-     * @return float The ratio of white pixels within the specified circle.
+     * @param features The features of the circle.
+     * @return float The ratio of white pixels within the circle.
      */
-    float get_white_ratio_in_circle_cue(const cv::Mat &src, const cv::Mat &segmentation_mask, cv::Vec3f circle);
+    float get_white_ratio_in_circle_cue(const ball_features &features);
 
     /**
-     * @brief Computes the ratio of black pixels within a specified circle on the source image for looking for the black ball.
+     * @brief Computes the ratio of black pixels within a circle for looking for the black ball.
      *
-     * This function calculates the ratio of black pixels within a given circle, intersected with the provided segmentation mask.
-     * It uses a specific range in the HSV color space to determine the black pixels.
-     *
-     * @param src The source image in HSV color space.
-     * @param segmentation_mask The segmentation mask used to exclude certain areas.
-     * @param circle A Vec3f representing a circle (x, y, radius) where the calculation is performed.
-     * @return float The ratio of black pixels within the specified circle.
+     * @param features The features of the circle.
+     * @return float The ratio of black pixels within the circle.
      */
-    float get_black_ratio_in_circle(const cv::Mat &src, const cv::Mat &segmentation_mask, cv::Vec3f circle);
+    float get_black_ratio_in_circle(const ball_features &features);
 
     /**
-     * @brief Filters out circles that are close to each other but significantly different in radius and position.
+     * @brief Rejects circles that are close to each other but significantly different in radius and position.
+     *
+     * Only the circles not rejected yet are compared, and each of them only with its neighbors indexed by the grid.
      *
      * @param circles A vector of circles to filter.
+     * @param grid The grid indexing the circles.
      * @param neighborhood_threshold Distance threshold for neighborhood consideration.
      * @param distance_threshold Distance threshold for circle position comparison.
      * @param radius_threshold Radius difference threshold for filtering.
+     * @param rejected Flags of the rejected circles, updated with the dissimilar circles.
      */
-    void filter_close_dissimilar_circles(std::vector<cv::Vec3f> &circles, float neighborhood_threshold, float distance_threshold, float radius_threshold);
+    void filter_close_dissimilar_circles(const std::vector<cv::Vec3f> &circles, const circle_grid &grid, float neighborhood_threshold, float distance_threshold, float radius_threshold, std::vector<bool> &rejected);
 
     /**
      * @brief Draws circles on an image.
@@ -204,19 +465,19 @@ private:
      * It calculates the absolute difference between the mean hue
      * and the middle hue value (128).
      *
-     * @param src Input source image in BGR format.
-     * @param segmentation_mask Binary mask where ball regions are masked out.
-     * @param circle A Vec3f representing the circle (x, y, radius).
+     * @param features The features of the circle.
      * @return The absolute distance of the mean hue value from 128.
      *
      */
-    float distance_from_middle_hue(const cv::Mat &src, const cv::Mat &segmentation_mask, cv::Vec3f circle);
+    float distance_from_middle_hue(const ball_features &features);
 
     /**
      * @brief Removes connected components from the mask that have a diameter smaller than a specified minimum.
      *
-     * This function iterates through connected components in the mask, computes the minimum enclosing circle for each component,
-     * and removes components whose diameter is less than the specified minimum diameter.
+     * This function labels the mask once and removes components whose minimum enclosing circle diameter is less than
+     * the specified minimum diameter. The diameter is bounded through the component bounding boxes, and the enclosing
+     * circle is computed only for components left undecided by the bounds, on points grouped by label in a single sweep.
+     * It is meant to be applied to circle patches.
      *
      * @param mask The binary mask from which small connected components will be removed.
      * @param min_diameter The minimum diameter threshold. Components with a diameter smaller than this value will be removed.
@@ -224,81 +485,80 @@ private:
     void remove_connected_components_by_diameter(cv::Mat &mask, double min_diameter);
 
     /**
-     * @brief Computes the ratio of white pixels within a specified circle on the source image for looking for striped balls.
-     *
-     * This function calculates the ratio of white pixels within a given circle, intersected with the provided segmentation mask.
-     * It uses a specific range in the HSV color space to determine the white pixels.
+     * @brief Computes the ratio of white pixels within a circle for looking for striped balls.
      *
-     * @param src The source image in HSV color space.
-     * @param segmentation_mask The segmentation mask used to exclude certain areas.
-     * @param circle A Vec3f representing a circle (x, y, radius) where the calculation is performed.
-     * @return float The ratio of white pixels within the specified circle.
+     * @param features The features of the circle.
+     * @return float The ratio of white pixels within the circle.
      */
-    float get_white_ratio_in_circle_stripes(const cv::Mat &src, const cv::Mat &segmentation_mask, cv::Vec3f circle);
+    float get_white_ratio_in_circle_stripes(const ball_features &features);
 
     /**
-     * @brief Identifies and localizes the cue ball in the given image.
+     * @brief Identifies and localizes the cue ball among the circles.
      *
-     * This function finds the cue ball by computing the white pixel ratio within each circle.
+     * This function finds the cue ball by considering the white pixel ratio within each circle.
      * The circle with the highest ratio is considered the cue ball.
      *
-     * @param src The source image.
-     * @param segmentation_mask The segmentation mask used to filter relevant areas.
      * @param circles A vector containing circles detected, where each circle is represented by a Vec3f (x, y, radius).
+     * @param features The features of each circle.
      */
-    void find_cue_ball(const cv::Mat &src, const cv::Mat &segmentation_mask, const std::vector<cv::Vec3f> &circles);
+    void find_cue_ball(const std::vector<cv::Vec3f> &circles, const std::vector<ball_features> &features);
 
     /**
-     * @brief Identifies and localizes the black ball in the given image.
+     * @brief Identifies and localizes the black ball among the circles.
      *
-     * This function finds the black ball by computing the black pixel ratio within each circle.
+     * This function finds the black ball by considering the black pixel ratio within each circle.
      * The circle with the highest ratio is considered the black ball.
      *
-     * @param src The source image.
-     * @param segmentation_mask The segmentation mask used to filter relevant areas.
      * @param circles A vector containing circles detected, where each circle is represented by a Vec3f (x, y, radius).
+     * @param features The features of each circle.
      */
-    void find_black_ball(const cv::Mat &src, const cv::Mat &segmentation_mask, const std::vector<cv::Vec3f> &circles);
+    void find_black_ball(const std::vector<cv::Vec3f> &circles, const std::vector<ball_features> &features);
 
     /**
-     * @brief Identifies and localizes the stripe balls in the given image.
+     * @brief Identifies and localizes the stripe balls among the circles.
      *
-     * This function finds the stripe balls by computing the white pixel ratio within each circle
+     * This function finds the stripe balls by considering the white pixel ratio within each circle
      * and filtering out circles that are likely cue or black balls.
      *
-     * @param src The source image.
-     * @param segmentation_mask The segmentation mask used to filter relevant areas.
      * @param circles A vector containing circles detected, where each circle is represented by a Vec3f (x, y, radius).
+     * @param features The features of each circle.
      */
-    void find_stripe_balls(const cv::Mat &src, const cv::Mat &segmentation_mask, const std::vector<cv::Vec3f> &circles);
+    void find_stripe_balls(const std::vector<cv::Vec3f> &circles, const std::vector<ball_features> &features);
 
     /**
-     * @brief Identifies and localizes the solid balls in the given image.
+     * @brief Identifies and localizes the solid balls among the circles.
      *
      * This function identifies solid balls by excluding the cue, black, and stripe balls from the detected circles.
      * The confidence for solid balls is estimated based on the confidences of other classified balls.
      *
-     * @param src The source image.
-     * @param segmentation_mask The segmentation mask used to filter relevant areas.
      * @param circles A vector containing circles detected, where each circle is represented by a Vec3f (x, y, radius).
      */
-    void find_solid_balls(const cv::Mat &src, const cv::Mat &segmentation_mask, const std::vector<cv::Vec3f> &circles);
-
-    /**
-     * @brief Generates a mask of the intersection between a circular region and the negated ball segmentation mask.
-     *
-     * @param segmentation_mask Binary mask where ball regions are masked out.
-     * @param circle A Vec3f representing a circle (x, y, radius).
-     * @param mask Output binary mask representing the intersection area.
-     */
-    void get_circle_and_field_mask(const cv::Mat &segmentation_mask, cv::Vec3f circle, cv::Mat &mask);
+    void find_solid_balls(const std::vector<cv::Vec3f> &circles);
 
     const float BOUNDING_BOX_RESCALE = 1.2;         // A scaling factor to rescale bounding boxes for better tracking.
     const float MAX_SIZE_BOUNDING_BOX_RESCALE = 14; // The maximum size limit for bounding box rescaling.
 
-    const playing_field_localization playing_field; //  An instance of playing_field_localization, which represents the playing field's localization data.
+    std::map<int, cv::Mat> disk_stencils;           // Cache of the filled disk stencils, indexed by radius.
+    parallel_region_grower region_grower;           // Region growing engine, reusing its buffers between growths.
+    board_color_estimator color_estimator;          // Board color estimator, reusing its histograms between frames.
+    const balls_localizer_options options;          // Options of the localizer.
+    playing_field_localization playing_field;       //  An instance of playing_field_localization, which represents the playing field's localization data.
+    cv::Rect table_box;                             // The box of the processed image holding the table, of the frame when cropping and of the rectified table when rectifying.
+    cv::Mat rectification;                          // Homography from the frame to the rectified table, empty unless rectifying the table.
+    playing_field_localization table_field;         // The playing field localization relative to the processed image of the table.
     std::vector<cv::Rect> bounding_boxes;           // A vector of cv::Rect objects storing the bounding boxes of detected balls.
     balls_localization localization;                // An instance of balls_localization, which contains the localization data of detected balls.
+    double resolution_scale = 1;                    // Scale of the pixel parameters at the resolution of the processed image.
+
+    // Scratch buffers of the localization, kept between frames so that frames of the same size reuse them.
+    cv::Mat blurred_masked_hsv;                              // Blurred HSV processed image, masked by the playing field.
+    cv::Mat src_masked_hsv;                                  // HSV processed image, masked by the playing field.
+    cv::Mat final_segmentation_mask;                         // Segmentation mask of the balls, where balls are black.
+    cv::Mat classified_mask;                                 // Board pixels classified by the cushion bands, before growing.
+    std::vector<std::vector<cv::Range>> shadow_shrinked_spans; // Row spans of the field beyond the shadow band.
+    std::vector<std::vector<cv::Range>> color_shrinked_spans;  // Row spans of the field beyond the color band.
+
+    std::vector<circle_filter_statistics> filters_statistics; // Statistics of the circle filters of the last localization.
 };
 
 #endif
\ No newline at end of file
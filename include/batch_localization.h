@@ -0,0 +1,88 @@
+// Author: Nicola Maritan 2121717
+
+#ifndef BATCH_LOCALIZATION_H
+#define BATCH_LOCALIZATION_H
+
+#include "frame_context.h"
+#include "playing_field_localization.h"
+#include "balls_localization.h"
+#include "frame_arena.h"
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/highgui.hpp>
+
+#include <memory>
+
+/**
+ * @brief Structure to hold the localizations of a frame, at its source resolution.
+ */
+struct frame_localization
+{
+    playing_field_localization playing_field;                 // Localization of the playing field.
+    balls_localization balls;                                 // Localization of the balls.
+    std::vector<circle_filter_statistics> filters_statistics; // Statistics of the circle filters on the frame.
+};
+typedef struct frame_localization frame_localization;
+
+/**
+ * @brief Class for localizing the playing field and the balls of batches of frames.
+ *
+ * Each worker keeps its frame context and its localizers, with their scratch buffers, between the frames and the
+ * batches, so that frames of the same size reuse the buffers of the previous ones. The temporaries of the
+ * localizers are taken from a frame arena of the worker, reset at the end of each frame. Workers localize
+ * disjoint frames of a batch in parallel.
+ */
+class batch_localizer
+{
+public:
+    /**
+     * @brief Constructor for batch_localizer.
+     *
+     * @param options The options of the balls localizer, whose crop option applies to the playing field localizer too.
+     * @param workers The number of frames localized in parallel.
+     * @param plf_options The options of the playing field localizer, except for the crop option.
+     */
+    batch_localizer(const balls_localizer_options &options = balls_localizer_options(), int workers = 1, const playing_field_localizer_options &plf_options = playing_field_localizer_options());
+
+    /**
+     * @brief Localizes the playing field and the balls of each frame of a batch.
+     *
+     * @param frames The BGR frames of the batch.
+     * @param localizations The output localizations, one per frame in the same order.
+     */
+    void localize_batch(const std::vector<cv::Mat> &frames, std::vector<frame_localization> &localizations);
+
+    /**
+     * @brief Returns the counters of the frame arenas of the workers, summed.
+     *
+     * @return the counters of the arenas.
+     */
+    frame_arena_statistics get_arena_statistics() const;
+
+private:
+    /**
+     * @brief Structure to hold the state reused by a worker between frames, created on its first frame.
+     */
+    struct localization_worker
+    {
+        std::unique_ptr<frame_arena> arena;                      // Arena of the temporaries of the localizations.
+        std::unique_ptr<frame_context> context;                  // Context of the current frame.
+        std::unique_ptr<playing_field_localizer> plf_localizer; // Playing field localizer.
+        std::unique_ptr<balls_localizer> blls_localizer;        // Balls localizer, moved to the playing field of each frame.
+    };
+
+    /**
+     * @brief Localizes the playing field and the balls of a frame with the state of a worker.
+     *
+     * @param worker The worker localizing the frame.
+     * @param frame The BGR frame.
+     * @param localization The output localization of the frame.
+     */
+    void localize_frame(localization_worker &worker, const cv::Mat &frame, frame_localization &localization);
+
+    const balls_localizer_options options;             // Options of the balls localizer.
+    const playing_field_localizer_options plf_options; // Options of the playing field localizer.
+    std::vector<localization_worker> workers;          // State of each worker.
+};
+
+#endif
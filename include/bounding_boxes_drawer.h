@@ -16,11 +16,15 @@ public:
      * @brief Constructor for bounding_boxes_drawer, initializes the object with playing field and ball localization data,
      *        and determines the indices of various types of balls within the multi-tracker bounding boxes.
      *
+     * The localizations and the bounding boxes refer to the working frames, and are mapped to the source frames only
+     * when drawn.
+     *
      * @param plf_localization Playing field localization.
      * @param blls_localization Balls localization.
      * @param tracker_bboxes Vector of bounding boxes from the multi-tracker.
+     * @param resolution The resolution of the frames.
      */
-    bounding_boxes_drawer(const playing_field_localization &plf_localization, const balls_localization &blls_localization, const std::vector<cv::Rect2d> &tracker_bboxes);
+    bounding_boxes_drawer(const playing_field_localization &plf_localization, const balls_localization &blls_localization, const std::vector<cv::Rect2d> &tracker_bboxes, const frame_resolution &resolution);
 
     /**
      * @brief Draws bounding boxes and lines on the given frame.
@@ -29,9 +33,9 @@ public:
      * solids, and stripes) with different colors and a specified transparency on the
      * provided frame. It also draws yellow lines along the corners of the playing field.
      *
-     * @param frame The input image on which to draw the bounding boxes.
+     * @param frame The input source frame on which to draw the bounding boxes.
      * @param dst The output image with the drawn bounding boxes and lines.
-     * @param updated_balls_bboxes A vector containing the bounding boxes for the objects.
+     * @param updated_balls_bboxes A vector containing the bounding boxes for the objects, in working frame coordinates.
      */
     void draw(const cv::Mat &frame, cv::Mat &dst, const std::vector<cv::Rect2d> &updated_balls_bboxes);
 
@@ -57,6 +61,7 @@ private:
     std::vector<int> stripes_indeces;           // Stripe balls indeces.
     playing_field_localization playing_field;   // Playing field localization
     balls_localization balls;                   // Balls localization
+    frame_resolution resolution;                // Resolution of the frames, mapping the boxes to the source frames
 };
 
 #endif
\ No newline at end of file
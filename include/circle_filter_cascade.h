@@ -0,0 +1,125 @@
+// Author: Nicola Maritan 2121717
+
+#ifndef CIRCLE_FILTER_CASCADE_H
+#define CIRCLE_FILTER_CASCADE_H
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/highgui.hpp>
+
+#include <functional>
+#include <string>
+
+/**
+ * @brief Structure to hold the statistics of a stage of a circle filter cascade.
+ */
+struct circle_filter_statistics
+{
+    std::string name; // Name of the stage.
+    int candidates;   // Number of candidate circles visited by the stage.
+    int rejected;     // Number of candidate circles rejected by the stage.
+    double time;      // Time spent in the stage, in milliseconds.
+};
+typedef struct circle_filter_statistics circle_filter_statistics;
+
+/**
+ * @brief Filter of a cascade stage.
+ *
+ * The filter visits the circles not rejected yet and flags the ones it rejects, leaving the others untouched.
+ */
+typedef std::function<void(const std::vector<cv::Vec3f> &circles, std::vector<bool> &rejected)> circle_filter;
+
+/**
+ * @brief Structure to hold a stage of a circle filter cascade.
+ */
+struct circle_filter_stage
+{
+    std::string name;     // Name of the stage.
+    circle_filter filter; // Filter of the stage.
+};
+typedef struct circle_filter_stage circle_filter_stage;
+
+/**
+ * @brief Class for filtering candidate circles through a cascade of filters, measuring each stage.
+ *
+ * Independent stages decide on each circle regardless of the other circles, so they can run in any order with the
+ * same final set of circles, and each of them visits only the circles surviving the previous stages. The final stage
+ * depends on the surviving circles, therefore it always runs last.
+ */
+class circle_filter_cascade
+{
+public:
+    /**
+     * @brief Appends an independent stage to the cascade.
+     *
+     * @param name The name of the stage.
+     * @param filter The filter of the stage.
+     */
+    void add_stage(const std::string &name, const circle_filter &filter);
+
+    /**
+     * @brief Sets the stage that runs after all the independent ones.
+     *
+     * @param name The name of the stage.
+     * @param filter The filter of the stage.
+     */
+    void set_final_stage(const std::string &name, const circle_filter &filter);
+
+    /**
+     * @brief Reorders the independent stages.
+     *
+     * The named stages run first, in the given order, followed by the other ones in their current order. The final
+     * stage may be named too, as in the orders ranking every stage, and still runs last.
+     *
+     * @param order The names of the stages.
+     */
+    void set_order(const std::vector<std::string> &order);
+
+    /**
+     * @brief Filters the circles through the cascade.
+     *
+     * @param circles A vector of circles to filter.
+     */
+    void apply(std::vector<cv::Vec3f> &circles);
+
+    /**
+     * @brief Returns the statistics of the last application, in the order the stages ran.
+     *
+     * @return the statistics of each stage.
+     */
+    const std::vector<circle_filter_statistics> &get_statistics() const { return statistics; }
+
+private:
+    /**
+     * @brief Runs a stage, recording its statistics.
+     *
+     * @param stage The stage to run.
+     * @param circles The circles to filter.
+     * @param rejected Flags of the rejected circles.
+     * @param candidates The number of circles not rejected yet, updated after the stage.
+     */
+    void run_stage(const circle_filter_stage &stage, const std::vector<cv::Vec3f> &circles, std::vector<bool> &rejected, int &candidates);
+
+    std::vector<circle_filter_stage> stages;          // Independent stages, in running order.
+    circle_filter_stage final_stage;                  // Stage running after the independent ones, if any.
+    std::vector<circle_filter_statistics> statistics; // Statistics of the last application.
+};
+
+/**
+ * @brief Accumulates the statistics of an application of a cascade, matching the stages by name.
+ *
+ * @param total The accumulated statistics, updated with the new ones.
+ * @param statistics The statistics of an application.
+ */
+void accumulate_circle_filter_statistics(std::vector<circle_filter_statistics> &total, const std::vector<circle_filter_statistics> &statistics);
+
+/**
+ * @brief Orders stages by their measured cost per candidate over their rejection rate, the best first.
+ *
+ * Stages rejecting no candidate come last. The order can be given to circle_filter_cascade::set_order.
+ *
+ * @param statistics The statistics of the stages.
+ * @param order Output names of the stages.
+ */
+void get_circle_filter_order(const std::vector<circle_filter_statistics> &statistics, std::vector<std::string> &order);
+
+#endif
@@ -0,0 +1,59 @@
+// Author: Nicola Maritan 2121717
+
+#ifndef CIRCLE_GRID_H
+#define CIRCLE_GRID_H
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/highgui.hpp>
+
+/**
+ * @brief Class indexing circles on a uniform grid of their centers.
+ *
+ * The grid spans the bounding box of the centers, and each cell stores the indices of the circles whose center falls
+ * in it. A neighborhood query visits only the cells overlapping the square around the query point, so its cost does
+ * not depend on the number of circles far from it.
+ */
+class circle_grid
+{
+public:
+    /**
+     * @brief Constructor for circle_grid.
+     *
+     * @param circles The circles to index, each represented by a Vec3f (x, y, radius).
+     * @param cell_size The side of the cells, best set to the most common query radius.
+     */
+    circle_grid(const std::vector<cv::Vec3f> &circles, float cell_size);
+
+    /**
+     * @brief Finds the circles whose center may lie within a given distance from a point.
+     *
+     * All the circles within the distance are returned, together with some farther ones, so the caller
+     * is in charge of the exact distance test.
+     *
+     * @param point The query point.
+     * @param distance The query distance.
+     * @param indices Output indices of the candidate circles.
+     */
+    void query(cv::Point2f point, float distance, std::vector<int> &indices) const;
+
+private:
+    /**
+     * @brief Returns the range of cells overlapping an interval of coordinates along an axis.
+     *
+     * @param start The start of the interval.
+     * @param end The end of the interval.
+     * @param origin The origin of the grid along the axis.
+     * @param cells The number of cells along the axis.
+     * @return The range of cells, empty if the interval lies outside the grid.
+     */
+    cv::Range get_cells_range(float start, float end, float origin, int cells) const;
+
+    float cell_size;               // Side of the cells.
+    cv::Point2f origin;            // Top left corner of the grid.
+    int cols;                      // Number of columns of cells.
+    int rows;                      // Number of rows of cells.
+    std::vector<int> cell_starts;  // Start of the circles of each cell in cell_circles, followed by their end.
+    std::vector<int> cell_circles; // Indices of the circles, grouped by cell.
+};
+
+#endif
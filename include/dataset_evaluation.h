@@ -3,6 +3,8 @@
 #ifndef DATASET_EVALUATION_H
 #define DATASET_EVALUATION_H
 
+#include "balls_localization.h"
+
 #include <opencv2/imgproc.hpp>
 #include <opencv2/highgui.hpp>
 
@@ -12,7 +14,22 @@
  * (the mean Intersection over Union and the mean Average Precision) to a text file.
  *
  * @param dataset_path A string representing the directory path containing the images and ground truth files.
+ * @param options The options of the balls localizer.
+ * @param workers The number of frames localized in parallel.
+ * @param plf_options The options of the playing field localizer, whose crop option is taken from the balls localizer ones.
+ */
+void evaluate(const std::string& dataset_path, const balls_localizer_options &options = balls_localizer_options(), int workers = 1, const playing_field_localizer_options &plf_options = playing_field_localizer_options());
+
+/**
+ * @brief Orders the independent circle filters by their cost per rejected candidate, measured by localizing the
+ * frames of a dataset, so that the order can be given to the balls localizer options.
+ *
+ * @param dataset_path A string representing the directory path containing the images.
+ * @param options The options of the balls localizer, whose filters order is the one measured.
+ * @param workers The number of frames localized in parallel.
+ * @param plf_options The options of the playing field localizer.
+ * @param order Output names of the filters, the best first.
  */
-void evaluate(const std::string& dataset_path);
+void rank_circle_filters(const std::string &dataset_path, const balls_localizer_options &options, int workers, const playing_field_localizer_options &plf_options, std::vector<std::string> &order);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,134 @@
+// Author: Nicola Maritan 2121717
+
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <opencv2/core.hpp>
+
+#include <vector>
+
+/**
+ * @struct frame_arena_statistics
+ * @brief Struct holding the counters of a frame arena.
+ *
+ * @var allocated_bytes The bytes handed out to matrices since the construction of the arena.
+ * @var frame_allocated_bytes The bytes handed out to matrices since the last reset.
+ * @var peak_bytes The peak of the bytes of the matrices alive at once.
+ * @var reserved_bytes The bytes of the chunks taken from the heap.
+ * @var heap_allocations The number of chunks taken from the heap.
+ * @var warm_heap_allocations The number of chunks taken from the heap after the first reset, zero in the steady state.
+ */
+struct frame_arena_statistics
+{
+    size_t allocated_bytes = 0;
+    size_t frame_allocated_bytes = 0;
+    size_t peak_bytes = 0;
+    size_t reserved_bytes = 0;
+    int heap_allocations = 0;
+    int warm_heap_allocations = 0;
+};
+typedef struct frame_arena_statistics frame_arena_statistics;
+
+/**
+ * @brief Sums the counters of two frame arenas, the peaks of arenas alive at once being summed too.
+ *
+ * @param total The counters to which the others are added.
+ * @param statistics The counters to add.
+ */
+void accumulate_frame_arena_statistics(frame_arena_statistics &total, const frame_arena_statistics &statistics);
+
+struct frame_arena_chunk;
+
+/**
+ * @brief Class providing the memory of the matrices created while it is active on a thread, as a bump allocator
+ * over chunks reused between frames.
+ *
+ * Matrices are served by the default cv::MatAllocator, which takes the memory from the arena active on the calling
+ * thread, if any, and from the standard allocator otherwise. A chunk is rewound once none of its matrices is alive,
+ * so that after the first frames the temporaries of a frame take no memory from the heap. Matrices outliving
+ * the frame, or even the arena, stay valid and only keep their chunk from being reused until they are released.
+ * An arena must be active on a single thread at a time, while its matrices can be released by any thread.
+ */
+class frame_arena
+{
+public:
+    /**
+     * @brief Constructor for frame_arena.
+     *
+     * @param chunk_size The size of the chunks taken from the heap, larger matrices taking a chunk of their size.
+     */
+    frame_arena(size_t chunk_size = 32 << 20);
+
+    /**
+     * @brief Destructor for frame_arena, freeing the chunks without alive matrices.
+     */
+    ~frame_arena();
+
+    frame_arena(const frame_arena &) = delete;
+    frame_arena &operator=(const frame_arena &) = delete;
+
+    /**
+     * @brief Marks the end of a frame, rewinding the chunks without alive matrices.
+     */
+    void reset();
+
+    /**
+     * @brief Returns the counters of the arena.
+     *
+     * @return the counters of the arena.
+     */
+    frame_arena_statistics get_statistics() const;
+
+    /**
+     * @brief Takes the memory of a matrix and of its header from the arena.
+     *
+     * @param size The bytes of the matrix.
+     * @param allocator The allocator releasing the matrix.
+     * @return the header of the matrix.
+     */
+    cv::UMatData *allocate(size_t size, const cv::MatAllocator *allocator);
+
+private:
+    /**
+     * @brief Returns a chunk with room for a block, rewinding or taking from the heap one if needed.
+     *
+     * @param block_size The bytes of the block.
+     * @return the chunk.
+     */
+    frame_arena_chunk *get_chunk(size_t block_size);
+
+    const size_t chunk_size;                  // Size of the chunks taken from the heap.
+    std::vector<frame_arena_chunk *> chunks;  // Chunks of the arena.
+    frame_arena_chunk *current_chunk;         // Chunk the blocks are bumped from.
+    frame_arena_statistics statistics;        // Counters of the arena, the alive bytes being kept by the chunks.
+    bool is_warm = false;                     // Whether the arena has been reset at least once.
+};
+
+/**
+ * @brief Class activating a frame arena on the current thread for its lifetime.
+ *
+ * Scopes can be nested, the previous arena being active again when the scope ends.
+ */
+class frame_arena_scope
+{
+public:
+    /**
+     * @brief Constructor for frame_arena_scope.
+     *
+     * @param arena The arena taking the matrices created on the current thread.
+     */
+    frame_arena_scope(frame_arena &arena);
+
+    /**
+     * @brief Destructor for frame_arena_scope, activating the previous arena.
+     */
+    ~frame_arena_scope();
+
+    frame_arena_scope(const frame_arena_scope &) = delete;
+    frame_arena_scope &operator=(const frame_arena_scope &) = delete;
+
+private:
+    frame_arena *previous_arena; // Arena active on the thread before the scope, if any.
+};
+
+#endif
@@ -0,0 +1,218 @@
+// Author: Nicola Maritan 2121717
+
+#ifndef FRAME_CONTEXT_H
+#define FRAME_CONTEXT_H
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/highgui.hpp>
+
+#include <map>
+#include <utility>
+
+const cv::Size REFERENCE_FRAME_SIZE = cv::Size(1024, 576); // Resolution the pixel parameters of the localizers are tuned for.
+
+/**
+ * @struct frame_resolution
+ * @brief Struct describing the resolution at which a frame is processed.
+ *
+ * Frames exceeding the reference resolution in width or height are downsampled to fit within it, so that the cost
+ * per frame is bounded whatever the source, while smaller frames are processed as they are. Every pixel parameter of the localizers,
+ * tuned for the reference resolution, is multiplied by the scale.
+ *
+ * @var source_size The size of the input frame.
+ * @var working_size The size of the frame processed by the localizers.
+ * @var scale The ratio between the working resolution and the reference one, at most 1.
+ */
+struct frame_resolution
+{
+    cv::Size source_size;
+    cv::Size working_size;
+    double scale;
+};
+typedef struct frame_resolution frame_resolution;
+
+/**
+ * @brief Computes the resolution at which a frame of the given size is processed.
+ *
+ * @param source_size The size of the input frame.
+ * @return the resolution of the frame.
+ */
+frame_resolution get_frame_resolution(const cv::Size &source_size);
+
+/**
+ * @brief Scales a pixel length tuned for the reference resolution.
+ *
+ * @param length The length at the reference resolution.
+ * @param scale The scale of the resolution.
+ * @return the rounded scaled length, at least 1.
+ */
+int get_scaled_length(double length, double scale);
+
+/**
+ * @brief Scales the size of a filter tuned for the reference resolution, keeping it odd.
+ *
+ * @param size The odd size at the reference resolution.
+ * @param scale The scale of the resolution.
+ * @return the scaled odd size, at least 1.
+ */
+int get_scaled_filter_size(int size, double scale);
+
+/**
+ * @brief Maps a box from the working resolution of a frame to its source resolution.
+ *
+ * @param box The box at the working resolution.
+ * @param resolution The resolution of the frame.
+ * @return the box at the source resolution.
+ */
+cv::Rect map_box_to_source(const cv::Rect &box, const frame_resolution &resolution);
+
+/**
+ * @brief Class holding a frame and the representations of it needed by the localizers.
+ *
+ * Each representation is computed at most once per frame and only the first time it is requested,
+ * so that the localizers can share it instead of converting the whole frame on every use. A context can be moved
+ * to the next frame of a sequence, reusing the buffers of its representations.
+ * Blurred representations are cached by their Gaussian filter parameters, downsampled ones by their pyramid level.
+ * All the representations are at the working resolution of the frame, which the localizations refer to.
+ */
+class frame_context
+{
+public:
+    /**
+     * @brief Constructor for frame_context.
+     *
+     * @param src The input BGR frame, downsampled to the working resolution if larger than the reference one.
+     */
+    frame_context(const cv::Mat &src);
+
+    /**
+     * @brief Constructor for frame_context of an image already at its working resolution, such as a part of a frame.
+     *
+     * @param src The input BGR image, processed as it is.
+     * @param scale The scale of the pixel parameters of the localizers on the image.
+     */
+    frame_context(const cv::Mat &src, double scale);
+
+    /**
+     * @brief Moves the context to a new input frame, invalidating its representations.
+     *
+     * The buffers of the representations are kept, so that frames of the same size reuse them.
+     *
+     * @param src The input BGR frame, downsampled to the working resolution if larger than the reference one.
+     */
+    void set_frame(const cv::Mat &src);
+
+    /**
+     * @brief Returns the BGR frame at the working resolution.
+     *
+     * @return the working frame.
+     */
+    const cv::Mat &get_frame() const { return frame; }
+
+    /**
+     * @brief Returns the input BGR frame at its source resolution.
+     *
+     * @return the source frame.
+     */
+    const cv::Mat &get_source_frame() const { return source_frame; }
+
+    /**
+     * @brief Returns the resolution of the frame.
+     *
+     * @return the resolution descriptor.
+     */
+    const frame_resolution &get_resolution() const { return resolution; }
+
+    /**
+     * @brief Returns the HSV representation of the input frame.
+     *
+     * @return the HSV frame.
+     */
+    const cv::Mat &get_hsv();
+
+    /**
+     * @brief Returns the input frame blurred with a Gaussian filter.
+     *
+     * @param filter_size The size of the Gaussian filter.
+     * @param filter_sigma The standard deviation of the Gaussian filter.
+     * @return the blurred BGR frame.
+     */
+    const cv::Mat &get_blurred(int filter_size, double filter_sigma);
+
+    /**
+     * @brief Returns the HSV representation of the blurred input frame.
+     *
+     * @param filter_size The size of the Gaussian filter.
+     * @param filter_sigma The standard deviation of the Gaussian filter.
+     * @return the blurred HSV frame.
+     */
+    const cv::Mat &get_blurred_hsv(int filter_size, double filter_sigma);
+
+    /**
+     * @brief Returns the split channels of the HSV representation of the blurred input frame.
+     *
+     * The returned channels share the data of the cached representations, so they must not be modified.
+     *
+     * @param filter_size The size of the Gaussian filter.
+     * @param filter_sigma The standard deviation of the Gaussian filter.
+     * @return the hue, saturation and value channels of the blurred frame.
+     */
+    const std::vector<cv::Mat> &get_blurred_hsv_channels(int filter_size, double filter_sigma);
+
+    /**
+     * @brief Returns a level of the Gaussian pyramid of the input frame.
+     *
+     * @param level The level of the pyramid, each one halving the resolution of the previous one, 0 being the input frame.
+     * @return the downsampled BGR frame.
+     */
+    const cv::Mat &get_pyramid_level(int level);
+
+    /**
+     * @brief Returns the HSV representation of a level of the Gaussian pyramid of the input frame.
+     *
+     * @param level The level of the pyramid, 0 being the input frame.
+     * @return the downsampled HSV frame.
+     */
+    const cv::Mat &get_pyramid_hsv(int level);
+
+private:
+    typedef std::pair<int, double> filter_parameters; // Gaussian filter size and sigma.
+
+    /**
+     * @struct cached_image
+     * @brief Struct holding a representation of the frame with its buffer, kept between frames.
+     *
+     * @var image The representation, whose buffer is reused by the next frames.
+     * @var is_valid Whether the representation belongs to the current frame.
+     */
+    struct cached_image
+    {
+        cv::Mat image;
+        bool is_valid = false;
+    };
+
+    /**
+     * @struct cached_channels
+     * @brief Struct holding the split channels of a representation of the frame, kept between frames.
+     *
+     * @var channels The channels, whose buffers are reused by the next frames.
+     * @var is_valid Whether the channels belong to the current frame.
+     */
+    struct cached_channels
+    {
+        std::vector<cv::Mat> channels;
+        bool is_valid = false;
+    };
+
+    cv::Mat source_frame;                                               // The input BGR frame.
+    frame_resolution resolution;                                        // The resolution of the frame.
+    cv::Mat frame;                                                      // The BGR frame at the working resolution.
+    cached_image hsv;                                                   // HSV frame, computed when requested.
+    std::map<filter_parameters, cached_image> blurred;                  // Blurred BGR frames by filter parameters.
+    std::map<filter_parameters, cached_image> blurred_hsv;              // Blurred HSV frames by filter parameters.
+    std::map<filter_parameters, cached_channels> blurred_hsv_channels;  // Split blurred HSV frames by filter parameters.
+    std::map<int, cached_image> pyramid;                                // Gaussian pyramid levels of the frame by level.
+    std::map<int, cached_image> pyramid_hsv;                            // HSV pyramid levels by level.
+};
+
+#endif
@@ -3,6 +3,8 @@
 #ifndef FRAME_SEGMENTATION_H
 #define FRAME_SEGMENTATION_H
 
+#include "balls_localization.h"
+
 #include <opencv2/imgproc.hpp>
 #include <opencv2/highgui.hpp>
 
@@ -40,7 +42,18 @@ void get_colored_frame_segmentation(const cv::Mat& src, cv::Mat& dst, bool prese
  * @param src The source frame to be processed.
  * @param dst The destination frame where the colored segmentation result will be stored.
  * @param preserve_background Boolean flag to indicate if the background should be preserved in the segmentation.
+ * @param options The options of the balls localizer.
+ */
+void get_frame_segmentation(const cv::Mat &src, cv::Mat &dst, const balls_localizer_options &options = balls_localizer_options());
+
+/**
+ * @brief Draws the segmentation of the playing field and balls of a frame from their localizations.
+ *
+ * @param plf_localization The localization of the playing field.
+ * @param blls_localization The localization of the balls.
+ * @param size The size of the frame.
+ * @param dst The destination frame where the segmentation result will be stored.
  */
-void get_frame_segmentation(const cv::Mat &src, cv::Mat &dst);
+void draw_frame_segmentation(const playing_field_localization &plf_localization, const balls_localization &blls_localization, cv::Size size, cv::Mat &dst);
 
 #endif
\ No newline at end of file
@@ -124,4 +124,13 @@ bool are_parallel_lines(const std::pair<cv::Point, cv::Point>& line_1, const std
  */
 double intercept(const std::pair<cv::Point, cv::Point>& line);
 
+/**
+ * @brief Computes the polar representation of a line, given one of its points and its direction.
+ *
+ * @param point A point of the line.
+ * @param direction The direction of the line, such as the one fitted by fitLine.
+ * @return The line as (rho, theta), with theta in [0, pi) as the lines of HoughLines.
+ */
+cv::Vec2f get_polar_line(const cv::Point2f &point, const cv::Point2f &direction);
+
 #endif
\ No newline at end of file
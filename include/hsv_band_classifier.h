@@ -0,0 +1,62 @@
+// Author: Nicola Maritan 2121717
+
+#ifndef HSV_BAND_CLASSIFIER_H
+#define HSV_BAND_CLASSIFIER_H
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/highgui.hpp>
+
+/**
+ * @brief Structure to hold an HSV range, bounds included.
+ */
+struct hsv_range
+{
+    cv::Vec3b lowerbound; // Lower bound of the range.
+    cv::Vec3b upperbound; // Upper bound of the range.
+};
+typedef struct hsv_range hsv_range;
+
+/**
+ * @brief Class for classifying HSV pixels against a set of HSV bands in a single pass.
+ *
+ * A pixel is classified as white (255) if it lies within at least one band allowed at its position, black (0)
+ * otherwise. Each band can be restricted to the nonzero pixels of a mask. This is equivalent to the union of
+ * one inRange per band, each intersected with its restriction mask, but reads each HSV pixel only once.
+ * The kernel is vectorized with AVX2 or SSE4.1 instructions when the build enables them.
+ */
+class hsv_band_classifier
+{
+public:
+    /**
+     * @brief Constructor for hsv_band_classifier.
+     *
+     * @param bands The HSV bands, at most MAX_BANDS.
+     */
+    hsv_band_classifier(const std::vector<hsv_range> &bands);
+
+    /**
+     * @brief Classifies an HSV image.
+     *
+     * @param hsv The input image in HSV color space.
+     * @param dst The output binary mask.
+     * @param band_masks Optional restriction mask for each band. An empty mask does not restrict its band.
+     */
+    void classify(const cv::Mat &hsv, cv::Mat &dst, const std::vector<cv::Mat> &band_masks = std::vector<cv::Mat>()) const;
+
+    /**
+     * @brief Classifies a row of HSV pixels.
+     *
+     * @param hsv Pointer to the interleaved HSV pixels.
+     * @param band_masks Restriction row of each band, nullptr for an unrestricted band. The array itself can be nullptr.
+     * @param dst Pointer to the output row.
+     * @param length The number of pixels.
+     */
+    void classify_row(const uchar *hsv, const uchar *const *band_masks, uchar *dst, int length) const;
+
+    static const int MAX_BANDS = 4; // Maximum number of bands of a classifier.
+
+private:
+    std::vector<hsv_range> bands; // The HSV bands.
+};
+
+#endif
@@ -79,6 +79,16 @@ float evaluate_balls_and_playing_field_segmentation(const cv::Mat &predicted_mas
  */
 void get_balls_localization(const cv::Mat &src, balls_localization &localization);
 
+/**
+ * @brief Perform ball localization on an image and store the results, together with the statistics of the circle filters.
+ * 
+ * @param src The source image.
+ * @param localization The output ball localizations.
+ * @param filters_statistics The output statistics of the circle filters.
+ * @param options The options of the balls localizer.
+ */
+void get_balls_localization(const cv::Mat &src, balls_localization &localization, std::vector<circle_filter_statistics> &filters_statistics, const balls_localizer_options &options = balls_localizer_options());
+
 /**
  * @brief Load ground truth ball localization from a file.
  * 
@@ -3,6 +3,9 @@
 #ifndef PLAYING_FIELD_LOCALIZATION_H
 #define PLAYING_FIELD_LOCALIZATION_H
 
+#include "frame_context.h"
+#include "segmentation.h"
+
 #include <opencv2/imgproc.hpp>
 #include <opencv2/highgui.hpp>
 
@@ -10,76 +13,197 @@
  * @brief Structure to store localization information of the playing field.
  *
  * This structure holds the corners of the playing field, a mask representing the playing field area,
- * and the positions of the holes on the playing field.
+ * and the positions of the holes on the playing field. The cushion distance of the mask is computed once
+ * per table, so that depth tests from the table edges do not need any erosion of the mask. The expected
+ * radius of the balls at each image row follows from the corners and the known table proportions.
  */
 struct playing_field_localization
 {
     std::vector<cv::Point> corners;
     cv::Mat mask;
     std::vector<cv::Point> hole_points;
+    cv::Mat cushion_distance; // CV_16U, a pixel is kept by an erosion of the mask with a MORPH_CROSS element of even size k iff its value is at least k / 2.
+    std::vector<float> ball_radius_by_row; // Expected radius of a ball centered at each image row, empty when the corners do not describe a table.
+    cv::Rect table_box;                    // Bounding rectangle of the corners with a margin, clipped to the frame.
+    cv::Mat table_homography;              // Homography from the frame to the canonical table, empty when the corners do not describe a table.
 };
 
 typedef struct playing_field_localization playing_field_localization;
 
+const float CANONICAL_TABLE_LENGTH = 2;      // Length of the canonical table, whose long edges are horizontal.
+const float CANONICAL_TABLE_WIDTH = 1;       // Width of the canonical table.
+const float CANONICAL_BALL_RADIUS = 0.0225;  // Radius of a ball on the canonical table, 2.25% of its width.
+
+/**
+ * @brief Computes the cushion distance of each pixel of a playing field mask.
+ *
+ * The distance of a mask pixel is the minimum among the number of consecutive mask pixels at its left, above it,
+ * and one plus the ones at its right and below it, pixels out of the image counting as mask pixels. Therefore
+ * thresholding the distance at k / 2 is equivalent to the default erosion with a MORPH_CROSS element of even
+ * size k, whose anchor sees one more pixel on the left and upper arms. Pixels outside the mask have distance 0.
+ *
+ * @param mask The playing field mask.
+ * @param cushion_distance The output CV_16U distance.
+ */
+void compute_cushion_distance(const cv::Mat &mask, cv::Mat &cushion_distance);
+
+/**
+ * @brief Maps a playing field localization from the working resolution of a frame to its source resolution.
+ *
+ * The mask and the cushion distance are recomputed from the mapped corners, so that they are exact at the source resolution.
+ *
+ * @param localization The localization at the working resolution.
+ * @param resolution The resolution of the frame.
+ * @param dst The output localization at the source resolution.
+ */
+void map_to_source(const playing_field_localization &localization, const frame_resolution &resolution, playing_field_localization &dst);
+
+/**
+ * @struct playing_field_localizer_options
+ * @brief Struct representing the options of the playing field localizer.
+ *
+ * @var crop_to_table Whether the stages following the localization of the table component work on its box only.
+ * @var kmeans_sample_step The step between the rows and the columns of the pixels whose colors are clustered, 1 for every pixel.
+ * @var kmeans_warm_start Whether the color clustering of a frame starts from the centers of the previous frame.
+ */
+struct playing_field_localizer_options
+{
+    bool crop_to_table = false;
+    int kmeans_sample_step = 1;
+    bool kmeans_warm_start = false;
+};
+typedef struct playing_field_localizer_options playing_field_localizer_options;
+
 /**
  * @brief Class for localizing the playing field on an input image.
  */
 class playing_field_localizer
 {
 public:
+    /**
+     * @brief Constructor for playing_field_localizer.
+     *
+     * @param options The options of the localizer.
+     */
+    playing_field_localizer(const playing_field_localizer_options &options = playing_field_localizer_options())
+        : options{options}, kmeans_clusterer{{options.kmeans_sample_step, options.kmeans_warm_start}} {};
+
     /**
      * Localize the playing field.
      *
      * @param src The input image.
      */
     void localize(const cv::Mat &src);
+
+    /**
+     * Localize the playing field, sharing the frame representations through the given context.
+     * The localization refers to the working resolution of the frame. The localizer can be reused across frames,
+     * each localization having its own images.
+     *
+     * @param context The context of the input frame.
+     */
+    void localize(frame_context &context);
+
     playing_field_localization get_localization() { return localization; }
 
+    /**
+     * @brief Returns the centers of the last color clustering, such as to warm start another localizer on the same game.
+     *
+     * @return the centers of the Hue-Saturation clusters, empty before the first localization.
+     */
+    std::vector<cv::Point2f> get_kmeans_centers() const { return kmeans_clusterer.get_centers(); }
+
+    /**
+     * @brief Sets the centers the next warm started color clustering starts from.
+     *
+     * @param centers The centers of the Hue-Saturation clusters, such as the ones of another localizer on the same game.
+     */
+    void set_kmeans_centers(const std::vector<cv::Point2f> &centers) { kmeans_clusterer.set_centers(centers); }
+
 private:
     /**
      * @brief Perform segmentation of the image based on color. One of the clusters should
      * contain the whole table, surrounded by different clusters.
      *
-     * @param src The input image to segment.
+     * @param context The context of the frame to segment.
      * @param dst The segmented image.
      */
-    void segmentation(const cv::Mat &src, cv::Mat &dst);
+    void segmentation(frame_context &context, cv::Mat &dst);
 
     /**
-     * @brief Finds lines in the input edge-detected image using the Hough Transform.
+     * @brief Finds the corners of the table from a quadrilateral fitted to its contour, without voting for its edges.
+     *
+     * The convex hull of the contour, which ignores the dents of occlusions and of the balls on the cushions, is
+     * approximated by a polygon with increasing tolerance until it has at most four vertices. The quadrilateral is
+     * accepted if it is convex, its area is close to the one of the component, and its couples of opposite sides
+     * have comparable lengths. Each side is then fitted robustly to the contour pixels along its middle, away from
+     * the pockets rounding the corners, and refitted by least squares to the pixels within a few pixels from the
+     * fitted line. The corners are the intersections of adjacent sides.
      *
-     * @param edges Input edge-detected binary image.
-     * @param lines Output vector of lines, each represented by a Vec3f (rho, theta, number of votes).
+     * @param contour The outer contour of the table component, in frame coordinates.
+     * @param size The size of the frame.
+     * @param corners The output corners, empty if the quadrilateral is not accepted.
+     * @return true if the quadrilateral is accepted and its corners are within the frame, false otherwise.
      */
-    void find_lines(const cv::Mat &src, std::vector<cv::Vec3f> &lines);
+    bool fit_table_polygon(const std::vector<cv::Point> &contour, cv::Size size, std::vector<cv::Point> &corners);
 
     /**
-     * @brief Refines a vector of lines by eliminating similar lines. Similar lines are condensed
-     *        into a single line by computing their mean values.
+     * @brief Finds the four edges of the table with a Hough accumulator voted by the pixels of its contour.
+     *
+     * Each pixel votes only for the orientations within a few degrees of the normal of the contour at the pixel, so
+     * straight edges gather their votes in a single cluster of the accumulator, while the pixels of the corners and
+     * of the curved parts spread theirs. The orientations range from -45 to 135 degrees, so that the horizontal and
+     * vertical edges are far from the wrap of the accumulator. The strongest clusters are taken in turn, each one
+     * suppressing the lines similar to its own, and refined.
      *
-     * @param lines Input vector of lines, each represented by a Vec3f (rho, theta, number of votes).
-     * @param refined_lines Output vector of refined lines.
+     * @param contour The outer contour of the table component, in frame coordinates.
+     * @param size The size of the frame.
+     * @param lines Output vector of at most four lines, each represented by a Vec3f (rho, theta, number of votes).
      */
-    void refine_lines(const std::vector<cv::Vec3f> &lines, std::vector<cv::Vec3f> &refined_lines);
+    void find_lines(const std::vector<cv::Point> &contour, cv::Size size, std::vector<cv::Vec3f> &lines);
 
     /**
-     * @brief Draws lines on the input image and displays it.
+     * @brief Refines the line of a cluster of the accumulator.
      *
-     * @param src Input image on which lines will be drawn.
-     * @param lines Vector of lines to be drawn, each represented by a Vec3f (rho, theta, line_id).
+     * The line is the vote weighted mean of the cluster, then fitted by least squares to the contour pixels close
+     * to it whose normal agrees with its own.
+     *
+     * @param theta_bin The orientation bin of the peak of the cluster.
+     * @param rho The distance bin of the peak of the cluster, relative to the origin of the frame.
+     * @param votes The votes of the cluster.
+     * @param contour The contour of the table component.
+     * @return the refined line (rho, theta, number of votes), with theta in [0, pi).
      */
-    void draw_lines(const cv::Mat &src, const std::vector<cv::Vec3f> &lines);
+    cv::Vec3f refine_peak(int theta_bin, int rho, float votes, const std::vector<cv::Point> &contour);
 
     /**
-     * @brief Finds and removes lines similar to a reference line from a vector of lines.
+     * @brief Suppresses the clusters of the lines similar to a peak, so that the next peak is another edge.
      *
-     * @param reference_line The line to which other lines will be compared.
-     * @param lines Input vector of lines, from which similar lines will be removed.
-     * @param similar_lines Output vector of lines similar to the reference line.
-     * @param rho_threshold Threshold for the difference in rho to consider lines similar.
-     * @param theta_threshold Threshold for the difference in theta to consider lines similar.
+     * @param theta_bin The orientation bin of the peak.
+     * @param rho The distance bin of the peak, relative to the origin of the frame.
      */
-    void dump_similar_lines(const cv::Vec3f &reference_line, std::vector<cv::Vec3f> &lines, std::vector<cv::Vec3f> &similar_lines, float rho_threshold, float theta_threshold);
+    void suppress_peak(int theta_bin, int rho);
+
+    /**
+     * @brief Returns the votes of a cell of the accumulator, wrapping the orientations out of its range.
+     *
+     * @param theta_bin The orientation bin, possibly out of the accumulator.
+     * @param rho The distance bin, relative to the origin of the frame.
+     * @return the votes of the cell, 0 if the distance is out of the accumulator.
+     */
+    float get_votes(int theta_bin, int rho) const;
+
+    /**
+     * @brief Finds the corners of the table as the intersections of the edges, within the frame.
+     *
+     * Four edges are paired into the two couples of opposite edges with the most similar orientations, and only
+     * the edges of different couples are intersected. Otherwise every pair of edges is intersected.
+     *
+     * @param lines The edges of the table.
+     * @param size The size of the frame.
+     * @param corners The output corners.
+     */
+    void find_corners(const std::vector<cv::Vec3f> &lines, cv::Size size, std::vector<cv::Point> &corners);
 
     /**
      * @brief Performs non-maxima suppression on the connected components of the input image,
@@ -87,8 +211,19 @@ private:
      *
      * @param src Input binary image.
      * @param dst Output image where only the largest connected component is retained.
+     * @param component_box Output bounding box of the largest connected component, empty if there is none.
+     */
+    void non_maxima_connected_component_suppression(const cv::Mat &src, cv::Mat &dst, cv::Rect &component_box);
+
+    /**
+     * @brief Grows a box by a margin on each side, clipping it to the frame.
+     *
+     * @param box The box to grow.
+     * @param margin The margin added on each side.
+     * @param frame_size The size of the frame.
+     * @return the grown box, or the whole frame if the box is empty.
      */
-    void non_maxima_connected_component_suppression(const cv::Mat &src, cv::Mat &dst);
+    cv::Rect get_margined_box(const cv::Rect &box, int margin, cv::Size frame_size);
 
     /**
      * @brief Checks if a given point is within the bounds of an image.
@@ -121,7 +256,69 @@ private:
      */
     void estimate_holes_location(std::vector<cv::Point> &hole_points);
 
-    playing_field_localization localization;    // The localization information of the playing field.
+    /**
+     * @brief Finds the long and short edges of the playing field from its corners, sorted clockwise.
+     *
+     * The view is in perspective if the angular coefficients of the diagonals have similar absolute value and
+     * opposite sign. If requested, it is in perspective also if the far edge is much shorter than the near one and the
+     * lateral edges are longer than half of the near one, which catches the off-center views along the table. In a perspective view the
+     * camera looks along the table, so the long edges are the lateral ones. Otherwise the image lengths of the edges
+     * reflect the real ones.
+     *
+     * @param corners The four corners of the playing field, sorted clockwise from the bottom left one.
+     * @param is_far_edge_tested Whether the length of the far edge is tested too, as the table homography needs.
+     * @param short_edge The output short edge.
+     * @param long_edge_1 The output long edge starting from the first corner, or from the second one if the first edge is short.
+     * @param long_edge_2 The output opposite long edge.
+     * @return true if the view is in perspective, false otherwise.
+     */
+    bool find_table_edges(const std::vector<cv::Point> &corners, bool is_far_edge_tested, std::pair<cv::Point, cv::Point> &short_edge, std::pair<cv::Point, cv::Point> &long_edge_1, std::pair<cv::Point, cv::Point> &long_edge_2);
+
+    /**
+     * @brief Estimates the homography from the frame to the canonical table, mapping the long edges of the
+     * playing field to the horizontal edges of the canonical table.
+     *
+     * @param table_homography The output homography, empty if the corners do not describe a table.
+     */
+    void estimate_table_homography(cv::Mat &table_homography);
+
+    /**
+     * @brief Estimates the expected radius of a ball centered at each row of the image.
+     *
+     * The table homography gives the scale of the table plane along each image row at the middle of the playing
+     * field, which multiplied by the radius of a ball on the canonical table gives its radius in the image. Rows
+     * above and below the playing field take the radius of the nearest row of the field.
+     *
+     * @param mask The playing field mask.
+     * @param table_box The box of the mask holding the playing field, the only one scanned.
+     * @param ball_radius_by_row The output radius of each row, empty if the corners do not describe a table.
+     */
+    void estimate_ball_radius_by_row(const cv::Mat &mask, const cv::Rect &table_box, std::vector<float> &ball_radius_by_row);
+
+    const int THETA_BINS = 180;                    // Number of orientation bins of the accumulator, one per degree.
+    const int THETA_ORIGIN = -45;                  // Orientation of the first bin of the accumulator, in degrees.
+    const int THETA_WINDOW = 8;                    // Orientation bins voted by a pixel on each side of its normal.
+
+    const playing_field_localizer_options options; // Options of the localizer.
+    playing_field_localization localization;       // The localization information of the playing field, at the working resolution.
+    double resolution_scale = 1;                   // Scale of the pixel parameters at the working resolution of the frame.
+
+    // Scratch buffers of the localization, kept between frames so that frames of the same size reuse them.
+    cv::Mat segmented;                            // Color clusters of the frame.
+    cv::Mat mask;                                 // Mask of the board color cluster, then of its largest component.
+    std::vector<std::vector<cv::Point>> contours; // Outer contours of the mask.
+    std::vector<float> contour_normals;           // Orientation of the normal of the table contour at each pixel, in degrees.
+    std::vector<cv::Point> table_hull;            // Convex hull of the table contour.
+    std::vector<cv::Point> table_polygon;         // Quadrilateral approximating the convex hull.
+    std::vector<cv::Point> edge_inliers;          // Contour pixels of the edge being refined.
+    std::vector<float> theta_cos;                 // Cosine of the orientation of each bin.
+    std::vector<float> theta_sin;                 // Sine of the orientation of each bin.
+    cv::Mat accumulator;                          // CV_32F votes of the contour pixels, by orientation and distance.
+    cv::Mat clustered_votes;                      // Votes of the 3x3 cluster of each cell, suppressed as edges are found.
+    int max_rho = 0;                              // Distance of the origin of the frame from the first distance bin.
+
+    histogram_kmeans kmeans_clusterer;     // Clusterer of the frame colors, keeping its histogram and centers between frames.
+    board_color_estimator color_estimator; // Estimator of the board cluster, keeping its histograms between frames.
 };
 
 #endif
\ No newline at end of file
@@ -6,18 +6,132 @@
 #include <opencv2/imgproc.hpp>
 #include <opencv2/highgui.hpp>
 
+#include <atomic>
+#include <memory>
+
 /**
- * @brief Performs k-means clustering on an image for image segmentation.
+ * @struct histogram_kmeans_options
+ * @brief Struct representing the options of the histogram k-means clustering.
  *
- * This function applies the k-means clustering algorithm to the input image src and stores the resulting segmented image in dst.
- * The output image will have pixel values
- * replaced by their corresponding cluster centroid values, effectively segmenting the image based on color similarity.
+ * @var sample_step The step between the rows and the columns of the pixels whose histogram is clustered, 1 for every pixel.
+ * Every pixel is labeled anyway, with the center nearest to its value.
+ * @var warm_start Whether a clustering starts from the centers of the previous one, or from the ones set, refining them
+ * with a few iterations. If they do not settle within the iterations, the scene changed and the clustering starts cold.
+ */
+struct histogram_kmeans_options
+{
+    int sample_step = 1;
+    bool warm_start = false;
+};
+typedef struct histogram_kmeans_options histogram_kmeans_options;
+
+/**
+ * @brief Class for k-means clustering of the first two channels of an image, through their joint histogram.
  *
- * @param src The source image to be segmented.
- * @param dst The destination image where the segmented output is stored.
- * @param centroids The number of clusters (centroids) to use for k-means clustering.
+ * Pixels with the same pair of values fall into the same cluster, so the clustering runs on the occupied bins of the
+ * 256x256 histogram of the pair, each bin weighted by its count, with the same k-means++ seeding, attempts and
+ * iterations of kmeans. Each pixel is then labeled through a lookup table from its bin to the nearest center.
+ * The result is the one of kmeans on the image made of the two channels and a uniform third one, at the cost of a
+ * histogram pass and a lookup pass over the pixels. The buffers and the centers are kept between calls.
  */
-void kmeans(const cv::Mat &src, cv::Mat &dst, int centroids);
+class histogram_kmeans
+{
+public:
+    /**
+     * @brief Constructor for histogram_kmeans.
+     *
+     * @param options The options of the clustering.
+     */
+    histogram_kmeans(const histogram_kmeans_options &options = histogram_kmeans_options());
+
+    /**
+     * @brief Clusters the pixels by their first two channels.
+     *
+     * @param channel_0 The CV_8UC1 first channel of the image.
+     * @param channel_1 The CV_8UC1 second channel of the image, of the same size.
+     * @param channel_2 The uniform value of the third channel of the output.
+     * @param dst The CV_8UC3 output image, whose pixels hold the rounded center of their cluster and the third channel value.
+     * @param centroids The number of clusters (centroids).
+     */
+    void cluster(const cv::Mat &channel_0, const cv::Mat &channel_1, uchar channel_2, cv::Mat &dst, int centroids);
+
+    /**
+     * @brief Sets the centers a warm started clustering starts from, such as the ones of a clip of the same game.
+     *
+     * @param centers The centers, used only by a clustering with the same number of centroids.
+     */
+    void set_centers(const std::vector<cv::Point2f> &centers) { best_centers = centers; }
+
+    /**
+     * @brief Returns the centers of the last clustering, which the next warm started clustering starts from.
+     *
+     * @return the centers, empty before the first clustering.
+     */
+    std::vector<cv::Point2f> get_centers() const { return best_centers; }
+
+private:
+    /**
+     * @brief Counts the sampled pixels of each bin and collects the occupied bins as weighted points.
+     *
+     * @param channel_0 The first channel of the image.
+     * @param channel_1 The second channel of the image.
+     */
+    void build_histogram(const cv::Mat &channel_0, const cv::Mat &channel_1);
+
+    /**
+     * @brief Seeds the centers with k-means++, each new center being the best of a few candidates drawn
+     * with probability proportional to their weighted squared distance from the nearest center.
+     *
+     * @param centroids The number of centers to seed.
+     */
+    void seed_centers(int centroids);
+
+    /**
+     * @brief Refines the centers with the Lloyd iterations, stopping early once they settle.
+     *
+     * @param iterations The maximum number of iterations.
+     * @param tolerance The squared shift under which every center is settled.
+     * @return true if the centers settled within the iterations, false otherwise.
+     */
+    bool refine_centers(int iterations, float tolerance);
+
+    /**
+     * @brief Labels the points with the current centers and returns the compactness of the clustering.
+     *
+     * @return the weighted sum of the squared distances of the points from their nearest centers.
+     */
+    double get_compactness();
+
+    /**
+     * @brief Labels each point with its nearest center, storing the squared distance from it.
+     */
+    void assign_labels();
+
+    /**
+     * @brief Draws a point with probability proportional to its mass.
+     *
+     * @param total_mass The sum of the masses of the points.
+     * @return the index of the drawn point.
+     */
+    int sample_point(double total_mass);
+
+    static const int BINS = 256; // Number of bins of each channel.
+
+    const histogram_kmeans_options options; // Options of the clustering.
+
+    std::vector<int> histogram;            // Count of the pixels of each bin, indexed by channel_0 * BINS + channel_1.
+    std::vector<cv::Point2f> points;       // Values of the occupied bins.
+    std::vector<float> weights;            // Count of each point.
+    std::vector<float> distances;          // Squared distance of each point from its nearest center.
+    std::vector<double> masses;            // Mass of each point for the draws of the seeding.
+    std::vector<int> labels;               // Cluster of each point.
+    std::vector<cv::Point2f> centers;      // Centers of the current attempt.
+    std::vector<cv::Point2f> best_centers; // Centers of the best attempt, kept for the next warm started clustering.
+    std::vector<cv::Vec2f> sums;           // Weighted sum of the points of each cluster.
+    std::vector<float> cluster_weights;    // Sum of the weights of each cluster.
+    std::vector<cv::Vec2b> lookup_table;   // Rounded nearest center of each bin.
+    cv::RNG rng;                           // Generator of the seeding draws, reseeded by each clustering.
+};
 
 /**
  * @brief Performs region growing segmentation on an image.
@@ -34,6 +148,150 @@ void kmeans(const cv::Mat &src, cv::Mat &dst, int centroids);
  */
 void region_growing(const cv::Mat &src, cv::Mat &dst, const std::vector<cv::Point> &seeds, int threshold_0, int threshold_1, int threshold_2);
 
+/**
+ * @brief Structure to hold a horizontal span of pixels of a row, end excluded.
+ */
+struct pixel_span
+{
+    int row;   // Row of the span.
+    int start; // First column of the span.
+    int end;   // Column after the last one of the span.
+};
+typedef struct pixel_span pixel_span;
+
+/**
+ * @brief Class for region growing seeded by a mask, based on scanline span filling.
+ *
+ * The grown region is the same of region_growing seeded with every nonzero pixel of the seed mask: a pixel joins the
+ * region if it is 4-connected to a pixel of the region whose channels differ from its own by at most the thresholds.
+ * The region is filled one horizontal span at a time through row pointers, without materializing the seed points,
+ * and the span stack is kept between calls.
+ */
+class scanline_region_grower
+{
+public:
+    /**
+     * @brief Performs region growing on a three channels image, seeded by a mask.
+     *
+     * @param src The source image to be segmented.
+     * @param seed_mask The mask of the seed points, it must not share data with dst.
+     * @param dst The destination mask where the grown region is stored.
+     * @param threshold_0 The threshold for the first channel to control region growth.
+     * @param threshold_1 The threshold for the second channel to control region growth.
+     * @param threshold_2 The threshold for the third channel to control region growth.
+     */
+    void grow(const cv::Mat &src, const cv::Mat &seed_mask, cv::Mat &dst, int threshold_0, int threshold_1, int threshold_2);
+
+private:
+    /**
+     * @brief Checks if two pixels are similar according to the current thresholds.
+     *
+     * @param pixel Pointer to the channels of the first pixel.
+     * @param neighbor Pointer to the channels of the second pixel.
+     * @return true if each channel differs by at most its threshold, false otherwise.
+     */
+    bool are_similar(const uchar *pixel, const uchar *neighbor) const;
+
+    /**
+     * @brief Adds a pixel to the region, extending it horizontally to the widest span of similar pixels, and pushes the span.
+     *
+     * @param src The source image.
+     * @param dst The mask of the region.
+     * @param row The row of the pixel.
+     * @param col The column of the pixel.
+     */
+    void fill_span(const cv::Mat &src, cv::Mat &dst, int row, int col);
+
+    /**
+     * @brief Grows the region from the pushed spans to the similar pixels of the adjacent rows, until no span is left.
+     *
+     * @param src The source image.
+     * @param dst The mask of the region.
+     */
+    void grow_spans(const cv::Mat &src, cv::Mat &dst);
+
+    std::vector<pixel_span> spans; // Stack of the spans whose adjacent rows are still to visit.
+    int thresholds[3];             // Thresholds of the current growth.
+};
+
+/**
+ * @brief Class for region growing seeded by a mask, parallelized over horizontal strips of the image.
+ *
+ * The grown region is the same of scanline_region_grower. Each strip is labeled independently on the OpenCV thread
+ * pool with a union-find over its pixels, linking 4-connected similar pixels. Labels are then merged across the strip
+ * borders with a lock-free union-find, and the region is made of the components containing at least one seed.
+ * Images too small to be split fall back to the scanline region grower.
+ */
+class parallel_region_grower
+{
+public:
+    /**
+     * @brief Performs region growing on a three channels image, seeded by a mask.
+     *
+     * @param src The source image to be segmented.
+     * @param seed_mask The mask of the seed points, it must not share data with dst.
+     * @param dst The destination mask where the grown region is stored.
+     * @param threshold_0 The threshold for the first channel to control region growth.
+     * @param threshold_1 The threshold for the second channel to control region growth.
+     * @param threshold_2 The threshold for the third channel to control region growth.
+     */
+    void grow(const cv::Mat &src, const cv::Mat &seed_mask, cv::Mat &dst, int threshold_0, int threshold_1, int threshold_2);
+
+private:
+    /**
+     * @brief Checks if two pixels are similar according to the current thresholds.
+     *
+     * @param pixel Pointer to the channels of the first pixel.
+     * @param neighbor Pointer to the channels of the second pixel.
+     * @return true if each channel differs by at most its threshold, false otherwise.
+     */
+    bool are_similar(const uchar *pixel, const uchar *neighbor) const;
+
+    /**
+     * @brief Finds the root of the component of a pixel, halving the path to it.
+     *
+     * Parents never have a greater index than their children, so the halving is safe under concurrent unions.
+     *
+     * @param pixel The index of the pixel.
+     * @return The index of the root.
+     */
+    int find_root(int pixel);
+
+    /**
+     * @brief Merges the components of two pixels, linking the greater root under the smaller one.
+     *
+     * @param pixel The index of the first pixel.
+     * @param neighbor The index of the second pixel.
+     */
+    void unite(int pixel, int neighbor);
+
+    /**
+     * @brief Labels the components of a strip, considering only the pixels within the strip.
+     *
+     * @param src The source image.
+     * @param rows The rows of the strip.
+     */
+    void label_strip(const cv::Mat &src, const cv::Range &rows);
+
+    /**
+     * @brief Returns the rows of a strip.
+     *
+     * @param strip The index of the strip.
+     * @param strips The number of strips.
+     * @param rows The number of rows of the image.
+     * @return The rows of the strip.
+     */
+    cv::Range get_strip_rows(int strip, int strips, int rows) const;
+
+    const int MIN_STRIP_ROWS = 32; // Minimum number of rows of a strip.
+
+    std::unique_ptr<std::atomic<int>[]> parents;       // Union-find parent of each pixel.
+    std::unique_ptr<std::atomic<uchar>[]> seeded_roots; // Whether the component of each root contains a seed.
+    size_t capacity = 0;                                // Number of pixels the union-find arrays can hold.
+    int thresholds[3];                                  // Thresholds of the current growth.
+    scanline_region_grower serial_grower;               // Region grower for the images too small to be split.
+};
+
 /**
  * @brief Performs region growing on a given source binary image starting from seed points and produces a binary mask.
  *
@@ -47,15 +305,88 @@ void region_growing(const cv::Mat &src, cv::Mat &dst, const std::vector<cv::Poin
 void mask_region_growing(const cv::Mat &src, cv::Mat &dst, const std::vector<cv::Point> &seeds);
 
 /**
- * @brief Return the estimated board color.
+ * @brief Enum representing the statistic estimating the color of a region.
  *
- * It computes the color of the board by considering a circle of a given radius around
- * the center of the image and picking the median value.
+ * @var median_estimate The color of the middle pixel of the region sorted by norm, for images of continuous colors.
+ * Among the pixels of the median norm, the first one of the region by rows is taken.
+ * @var mode_estimate The most frequent pair of the first two channels, with the most frequent third channel among its
+ * pixels, for images of few colors such as the color clusters. The color is one of the region.
+ */
+enum color_estimate
+{
+    median_estimate,
+    mode_estimate
+};
+
+/**
+ * @brief Class for estimating the board color from the histograms of a region of an image.
  *
- * @param src Input image containing the board.
- * @param radius Radius from the image center in which to compute the board color.
- * @return the computed color of the board.
+ * The region is the whole image or a disk, optionally restricted to the nonzero pixels of a mask, such as the
+ * playing field mask. It is scanned by row spans into fixed size histograms, so the estimate takes linear time in
+ * the region. The histograms are kept between estimates, so that estimates do not allocate.
  */
-cv::Vec3b get_playing_field_color(const cv::Mat &src, float radius);
+class board_color_estimator
+{
+public:
+    /**
+     * @brief Estimates the color of the pixels of an image within a mask.
+     *
+     * @param src The CV_8UC3 image.
+     * @param mask The CV_8UC1 mask of the region, of the same size of the image, or an empty mat for the whole image.
+     * @param estimate The statistic of the estimate.
+     * @return the estimated color, black if the region is empty.
+     */
+    cv::Vec3b estimate(const cv::Mat &src, const cv::Mat &mask, color_estimate estimate);
+
+    /**
+     * @brief Estimates the color of the pixels of an image within a disk and a mask.
+     *
+     * @param src The CV_8UC3 image.
+     * @param center The center of the disk.
+     * @param radius The radius of the disk.
+     * @param mask The CV_8UC1 mask of the region, of the same size of the image, or an empty mat for the whole disk.
+     * @param estimate The statistic of the estimate.
+     * @return the estimated color, black if the region is empty.
+     */
+    cv::Vec3b estimate(const cv::Mat &src, cv::Point center, float radius, const cv::Mat &mask, color_estimate estimate);
+
+private:
+    /**
+     * @brief Estimates the color of the pixels of the current region.
+     *
+     * @param src The image.
+     * @param mask The mask of the region, or an empty mat.
+     * @param estimate The statistic of the estimate.
+     * @return the estimated color, black if the region is empty.
+     */
+    cv::Vec3b estimate_region(const cv::Mat &src, const cv::Mat &mask, color_estimate estimate);
+
+    /**
+     * @brief Returns the columns of a row within the current region, before the mask.
+     *
+     * @param row The row.
+     * @param cols The number of columns of the image.
+     * @return the columns of the row within the region, empty if there is none.
+     */
+    cv::Range get_region_span(int row, int cols) const;
+
+    /**
+     * @brief Returns the squared norm of a color, which sorts colors as their norm does.
+     *
+     * @param color The color.
+     * @return the squared norm of the color.
+     */
+    static int get_squared_norm(const cv::Vec3b &color) { return color[0] * color[0] + color[1] * color[1] + color[2] * color[2]; }
+
+    static const int BINS = 256;                    // Number of bins of each channel.
+    static const int NORM_BINS = 3 * 255 * 255 + 1; // Number of squared norms of the colors.
+
+    int third_histogram[BINS];        // Count of the pixels of each value of the third channel, for the mode.
+    std::vector<int> pair_histogram;  // Count of the pixels of each pair of the first two channels, for the mode.
+    std::vector<int> norm_histogram;  // Count of the pixels of each squared norm, for the median.
+    bool is_disk = false;             // Whether the current region is a disk.
+    cv::Point disk_center;            // Center of the current disk.
+    float disk_radius = 0;            // Radius of the current disk.
+};
 
 #endif
\ No newline at end of file
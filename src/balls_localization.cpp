@@ -3,11 +3,14 @@
 #include "balls_localization.h"
 #include "geometry.h"
 #include "segmentation.h"
+#include "hsv_band_classifier.h"
 
 #include <opencv2/features2d.hpp>
 
 #include <iostream>
+#include <cfloat>
 #include <cmath>
+#include <algorithm>
 #include <map>
 #include <queue>
 #include <cassert>
@@ -25,6 +28,130 @@ bool operator!=(const ball_localization &lhs, const ball_localization &rhs)
     return !(lhs == rhs);
 }
 
+/**
+ * @brief Maps a ball localization from the working resolution of a frame to its source resolution.
+ *
+ * @param ball The ball localization at the working resolution, left unchanged if it is not a localization.
+ * @param resolution The resolution of the frame.
+ */
+void map_ball_to_source(ball_localization &ball, const frame_resolution &resolution);
+
+void map_to_source(const balls_localization &localization, const frame_resolution &resolution, balls_localization &dst)
+{
+    dst = localization;
+    if (resolution.working_size == resolution.source_size)
+        return;
+
+    map_ball_to_source(dst.cue, resolution);
+    map_ball_to_source(dst.black, resolution);
+    for (ball_localization &ball : dst.solids)
+        map_ball_to_source(ball, resolution);
+    for (ball_localization &ball : dst.stripes)
+        map_ball_to_source(ball, resolution);
+}
+
+void map_ball_to_source(ball_localization &ball, const frame_resolution &resolution)
+{
+    if (ball == NO_LOCALIZATION)
+        return;
+
+    const float x_factor = static_cast<float>(resolution.source_size.width) / resolution.working_size.width;
+    const float y_factor = static_cast<float>(resolution.source_size.height) / resolution.working_size.height;
+    ball.circle = Vec3f(ball.circle[0] * x_factor, ball.circle[1] * y_factor, ball.circle[2] * x_factor);
+    ball.bounding_box = map_box_to_source(ball.bounding_box, resolution);
+}
+
+balls_localizer::balls_localizer(const playing_field_localization &localization, const balls_localizer_options &options)
+    : options{options}
+{
+    set_playing_field(localization);
+}
+
+void balls_localizer::set_playing_field(const playing_field_localization &localization)
+{
+    playing_field = localization;
+    table_box = Rect(Point(0, 0), playing_field.mask.size());
+    rectification = Mat();
+    table_field = playing_field;
+    if (options.rectify_table && !playing_field.table_homography.empty() && !playing_field.ball_radius_by_row.empty())
+    {
+        /*
+            Balls are not flat, so on the canonical table they are stretched along the view direction. The axes of the
+            canonical table are scaled so that a frame disk at the table center becomes a disk, which balls stay nearly
+            everywhere. The table is then fitted with a margin into a fixed size image, shrinking it further if balls
+            would be larger than a fixed radius, so that balls have nearly the same radius whatever the view.
+        */
+        const Mat &frame_to_table = playing_field.table_homography;
+        vector<Point2f> table_center = {Point2f(CANONICAL_TABLE_LENGTH / 2, CANONICAL_TABLE_WIDTH / 2)};
+        perspectiveTransform(table_center, table_center, frame_to_table.inv());
+        vector<Point2f> center_steps = {table_center.at(0) - Point2f(0.5, 0), table_center.at(0) + Point2f(0.5, 0),
+                                        table_center.at(0) - Point2f(0, 0.5), table_center.at(0) + Point2f(0, 0.5)};
+        perspectiveTransform(center_steps, center_steps, frame_to_table);
+        const Point2f column_step = center_steps.at(1) - center_steps.at(0);
+        const Point2f row_step = center_steps.at(3) - center_steps.at(2);
+        const double horizontal_extent = norm(Point2f(column_step.x, row_step.x));
+        const double vertical_extent = norm(Point2f(column_step.y, row_step.y));
+
+        const Size RECTIFIED_SIZE = Size(1056, 576);
+        const double RECTIFIED_MARGIN = 48;
+        const double aspect_ratio = vertical_extent / horizontal_extent;
+        double vertical_scale = min((RECTIFIED_SIZE.width - 2 * RECTIFIED_MARGIN) / (CANONICAL_TABLE_LENGTH * aspect_ratio), (RECTIFIED_SIZE.height - 2 * RECTIFIED_MARGIN) / CANONICAL_TABLE_WIDTH);
+
+        // Balls have the radius of the frame ones at the table center, scaled as the vertical axis, up to a fixed one
+        const double RECTIFIED_BALL_RADIUS = 11;
+        const int center_row = min(max(cvRound(table_center.at(0).y), 0), static_cast<int>(playing_field.ball_radius_by_row.size()) - 1);
+        const double frame_ball_radius = playing_field.ball_radius_by_row.at(center_row);
+        vertical_scale = min(vertical_scale, RECTIFIED_BALL_RADIUS / (frame_ball_radius * vertical_extent));
+        const double horizontal_scale = vertical_scale * aspect_ratio;
+
+        Mat canonical_to_rectified = Mat::eye(3, 3, CV_64F);
+        canonical_to_rectified.at<double>(0, 0) = horizontal_scale;
+        canonical_to_rectified.at<double>(1, 1) = vertical_scale;
+        canonical_to_rectified.at<double>(0, 2) = (RECTIFIED_SIZE.width - CANONICAL_TABLE_LENGTH * horizontal_scale) / 2;
+        canonical_to_rectified.at<double>(1, 2) = (RECTIFIED_SIZE.height - CANONICAL_TABLE_WIDTH * vertical_scale) / 2;
+        rectification = canonical_to_rectified * frame_to_table;
+
+        // The geometry is projected, the field becoming an axis aligned rectangle
+        vector<Point2f> corners(playing_field.corners.begin(), playing_field.corners.end());
+        vector<Point2f> hole_points(playing_field.hole_points.begin(), playing_field.hole_points.end());
+        perspectiveTransform(corners, corners, rectification);
+        if (!hole_points.empty())
+            perspectiveTransform(hole_points, hole_points, rectification);
+        table_field.corners.assign(corners.begin(), corners.end());
+        table_field.hole_points.assign(hole_points.begin(), hole_points.end());
+
+        Mat table_mask(RECTIFIED_SIZE, CV_8U);
+        table_mask.setTo(0);
+        fillConvexPoly(table_mask, table_field.corners, 255);
+        table_field.mask = table_mask;
+        compute_cushion_distance(table_mask, table_field.cushion_distance);
+        table_field.table_homography = canonical_to_rectified.inv();
+
+        // Only the box of the table is warped, the rest of the rectified image staying black
+        const int MARGIN = cvRound(RECTIFIED_MARGIN);
+        table_box = Rect(boundingRect(table_field.corners).tl() - Point(MARGIN, MARGIN), boundingRect(table_field.corners).br() + Point(MARGIN, MARGIN)) & Rect(Point(0, 0), RECTIFIED_SIZE);
+        table_field.table_box = table_box;
+        table_field.ball_radius_by_row.assign(RECTIFIED_SIZE.height, frame_ball_radius * vertical_extent * vertical_scale);
+        return;
+    }
+
+    if (!options.crop_to_table || playing_field.table_box.empty())
+        return;
+
+    // Views of the box, with the geometry moved to its coordinates
+    table_box = playing_field.table_box & table_box;
+    const Point OFFSET = table_box.tl();
+    table_field.mask = playing_field.mask(table_box);
+    table_field.cushion_distance = playing_field.cushion_distance(table_box);
+    table_field.table_box = Rect(Point(0, 0), table_box.size());
+    for (Point &corner : table_field.corners)
+        corner -= OFFSET;
+    for (Point &hole_point : table_field.hole_points)
+        hole_point -= OFFSET;
+    if (!playing_field.ball_radius_by_row.empty())
+        table_field.ball_radius_by_row.assign(playing_field.ball_radius_by_row.begin() + table_box.y, playing_field.ball_radius_by_row.begin() + table_box.y + table_box.height);
+}
+
 void balls_localizer::localize(const Mat &src)
 {
     if (src.empty())
@@ -33,125 +160,526 @@ void balls_localizer::localize(const Mat &src)
         throw invalid_argument(EMPTY_MAT_MESSAGE);
     }
 
-    const int FILTER_SIZE = 3;
-    const int FILTER_SIGMA = 3;
-    Mat blurred;
-    GaussianBlur(src, blurred, Size(FILTER_SIZE, FILTER_SIZE), FILTER_SIGMA, FILTER_SIGMA);
+    frame_context context(src);
+    localize(context);
+}
 
-    Mat src_masked;
-    src.copyTo(src_masked, playing_field.mask);
+void balls_localizer::localize(frame_context &context)
+{
+    if (context.get_frame().size() != playing_field.mask.size())
+    {
+        const string INVALID_FRAME_SIZE = "Frame size differs from the playing field one.";
+        throw invalid_argument(INVALID_FRAME_SIZE);
+    }
 
-    Mat blurred_masked;
-    blurred.copyTo(blurred_masked, playing_field.mask);
+    if (!rectification.empty())
+    {
+        // The warp samples only the frame pixels of the table and of its margin
+        Mat rectified(table_field.mask.size(), CV_8UC3);
+        rectified.setTo(Scalar(0, 0, 0));
+        Mat translation = Mat::eye(3, 3, CV_64F);
+        translation.at<double>(0, 2) = -table_box.x;
+        translation.at<double>(1, 2) = -table_box.y;
+        Mat rectified_table_box = rectified(table_box);
+        warpPerspective(context.get_frame(), rectified_table_box, translation * rectification, table_box.size(), INTER_LINEAR, BORDER_CONSTANT);
+
+        // The rectified image has a fixed size, for which the pixel parameters are tuned whatever the frame resolution
+        frame_context table_context(rectified, 1);
+        localize_table(table_context);
+        return;
+    }
 
-    Mat blurred_masked_hsv;
-    cvtColor(blurred_masked, blurred_masked_hsv, COLOR_BGR2HSV);
+    if (!options.crop_to_table)
+    {
+        localize_table(context);
+        return;
+    }
 
-    Mat src_masked_hsv;
-    cvtColor(src_masked, src_masked_hsv, COLOR_BGR2HSV);
+    // The representations of the box are computed from a view of the frame, filters seeing the pixels around it
+    frame_context table_context(context.get_frame()(table_box), context.get_resolution().scale);
+    localize_table(table_context);
+}
 
-    // Computation of board, shadows and color masks
-    Mat board_mask;
-    Mat shadows_mask;
-    Mat color_mask;
-    Mat final_segmentation_mask;
+void balls_localizer::localize_table(frame_context &context)
+{
+    if (options.pyramid_levels < 0)
+    {
+        const string INVALID_PYRAMID_LEVELS = "Invalid negative number of pyramid levels.";
+        throw invalid_argument(INVALID_PYRAMID_LEVELS);
+    }
 
-    // Playing field color estimation
-    int RADIUS = 100;
-    const Vec3b board_color_hsv = get_playing_field_color(blurred_masked_hsv, RADIUS);
-    const Vec3b SHADOW_OFFSET = Vec3b(0, 0, 90);
+    // Pixel parameters are tuned for the reference resolution
+    resolution_scale = context.get_resolution().scale;
+    const int MIN_BALL_RADIUS = 8;
+    const int MAX_BALL_RADIUS = 16;
+    const int MIN_BALLS_DISTANCE = 15;
+    const int min_ball_radius = get_scaled_length(MIN_BALL_RADIUS, resolution_scale);
+    const int max_ball_radius = get_scaled_length(MAX_BALL_RADIUS, resolution_scale);
+    const int min_balls_distance = get_scaled_length(MIN_BALLS_DISTANCE, resolution_scale);
+    localization = balls_localization();
+    vector<Vec3f> circles;
+    if (options.pyramid_levels > 0)
+        localize_coarse_to_fine(context, min_ball_radius, max_ball_radius, min_balls_distance, blurred_masked_hsv, src_masked_hsv, final_segmentation_mask, circles);
+    else
+    {
+        /*
+            Masking and color conversion commute, since black BGR pixels are black HSV pixels too.
+            Therefore the shared HSV representations of the context are masked directly.
+        */
+        const int FILTER_SIZE = 3;
+        const int FILTER_SIGMA = 3;
+        const Mat &blurred_hsv = context.get_blurred_hsv(get_scaled_filter_size(FILTER_SIZE, resolution_scale), FILTER_SIGMA * resolution_scale);
+        const Mat &src_hsv = context.get_hsv();
+        blurred_masked_hsv.create(blurred_hsv.size(), CV_8UC3);
+        blurred_masked_hsv.setTo(Scalar(0, 0, 0));
+        blurred_hsv.copyTo(blurred_masked_hsv, table_field.mask);
+        src_masked_hsv.create(src_hsv.size(), CV_8UC3);
+        src_masked_hsv.setTo(Scalar(0, 0, 0));
+        src_hsv.copyTo(src_masked_hsv, table_field.mask);
+
+        // Playing field color estimation, as the median by norm of the pixels around the center
+        const int RADIUS = 100;
+        const Point CENTER = Point(blurred_masked_hsv.cols / 2, blurred_masked_hsv.rows / 2);
+        const Vec3b board_color_hsv = color_estimator.estimate(blurred_masked_hsv, CENTER, get_scaled_length(RADIUS, resolution_scale), Mat(), median_estimate);
+
+        segment_balls(blurred_masked_hsv, table_field.cushion_distance, board_color_hsv, 1, true, final_segmentation_mask);
+        generate_candidates(final_segmentation_mask, min_ball_radius, max_ball_radius, min_balls_distance, 1, circles);
+    }
 
-    Vec3b shadow_hsv = board_color_hsv - SHADOW_OFFSET;
-    inRange(blurred_masked_hsv, board_color_hsv - Vec3b(5, 80, 50), board_color_hsv + Vec3b(5, 60, 15), board_mask);
-    inRange(blurred_masked_hsv, shadow_hsv - Vec3b(3, 30, 80), shadow_hsv + Vec3b(3, 100, 40), shadows_mask);
-    inRange(blurred_masked_hsv, board_color_hsv - Vec3b(10, 255, 150), shadow_hsv + Vec3b(10, 255, 255), color_mask);
+    // Disk stencils of the whole radius range of the candidates, shared by all the per-circle operations
+    for (int radius = min_ball_radius; radius <= max_ball_radius; radius++)
+        get_disk_stencil(radius);
 
-    Mat outer_field;
-    Mat shrinked_playing_field_mask;
+    // Circle filtering to remove wrongly detected circles by the transform.
+    const float MAX_INTERSECTION = 0.60;
+    const float MAX_DISTANCE_OUT_OF_BOUNDS = 20;
+    const float MIN_DISTANCE_FROM_HOLE = 27;
+    const float MIN_DISSIMILAR_NEIGHBORDHOOD_DISTANCE = 25;
+    const float MIN_DISSIMILAR_VERTICAL_DISTANCE = 25;
+    const float MIN_DISSIMILAR_RADIUS_DIFFERENCE = 2;
 
-    // Consider shadow mask only near the table edges
-    const int DEPTH_SHADOW_MASK = 50;
-    erode(playing_field.mask, shrinked_playing_field_mask, getStructuringElement(MORPH_CROSS, Size(DEPTH_SHADOW_MASK, DEPTH_SHADOW_MASK)));
-    bitwise_not(shrinked_playing_field_mask, outer_field);
-    bitwise_and(shadows_mask.clone(), outer_field, shadows_mask);
+    /*
+        Cascade of filters sharing a grid of the candidates. Filters independent from each other run from the cheapest
+        and most selective by default, since each one visits only the circles surviving the previous ones.
+    */
+    const float max_distance_out_of_bounds = MAX_DISTANCE_OUT_OF_BOUNDS * resolution_scale;
+    const float min_distance_from_hole = MIN_DISTANCE_FROM_HOLE * resolution_scale;
+    const float min_dissimilar_neighborhood_distance = MIN_DISSIMILAR_NEIGHBORDHOOD_DISTANCE * resolution_scale;
+    const float min_dissimilar_vertical_distance = MIN_DISSIMILAR_VERTICAL_DISTANCE * resolution_scale;
+    const float min_dissimilar_radius_difference = MIN_DISSIMILAR_RADIUS_DIFFERENCE * resolution_scale;
+    const circle_grid grid(circles, min_dissimilar_neighborhood_distance);
+    circle_filter_cascade filters;
+    filters.add_stage("out_of_bound", [&](const vector<Vec3f> &candidates, vector<bool> &rejected)
+                      { filter_out_of_bound_circles(candidates, table_field.cushion_distance, max_distance_out_of_bounds, rejected); });
+    filters.add_stage("near_holes", [&](const vector<Vec3f> &candidates, vector<bool> &rejected)
+                      { filter_near_holes_circles(candidates, grid, table_field.hole_points, min_distance_from_hole, rejected); });
+    filters.add_stage("empty", [&](const vector<Vec3f> &candidates, vector<bool> &rejected)
+                      { filter_empty_circles(candidates, final_segmentation_mask, MAX_INTERSECTION, rejected); });
+    filters.set_final_stage("close_dissimilar", [&](const vector<Vec3f> &candidates, vector<bool> &rejected)
+                            { filter_close_dissimilar_circles(candidates, grid, min_dissimilar_neighborhood_distance, min_dissimilar_vertical_distance, min_dissimilar_radius_difference, rejected); });
+    filters.set_order(options.filters_order);
+    filters.apply(circles);
+    filters_statistics = filters.get_statistics();
+
+    // Ball classification among detected circles, based on features extracted in a single pass per circle
+    vector<ball_features> features;
+    extract_ball_features(blurred_masked_hsv, src_masked_hsv, final_segmentation_mask, circles, features);
+
+    // Features are computed, so the circles are moved from the processed image to the frame
+    map_circles_to_frame(circles);
+    find_cue_ball(circles, features);
+    find_black_ball(circles, features);
+    find_stripe_balls(circles, features);
+    find_solid_balls(circles);
 
-    // Consider color mask only near the table edges
-    const int DEPTH_COLOR_MASK = 30;
-    erode(playing_field.mask, shrinked_playing_field_mask, getStructuringElement(MORPH_CROSS, Size(DEPTH_COLOR_MASK, DEPTH_COLOR_MASK)));
-    bitwise_not(shrinked_playing_field_mask, outer_field);
-    bitwise_and(color_mask.clone(), outer_field, color_mask);
+    get_bounding_boxes(circles, bounding_boxes);
+}
 
-    // Union of the above masks
-    bitwise_or(board_mask, shadows_mask, final_segmentation_mask);
-    bitwise_or(final_segmentation_mask, color_mask, final_segmentation_mask);
+void balls_localizer::segment_balls(const Mat &blurred_masked_hsv, const Mat &cushion_distance, const Vec3b &board_color_hsv, int scale, bool merge_corner, Mat &dst)
+{
+    const Vec3b SHADOW_OFFSET = Vec3b(0, 0, 90);
+    Vec3b shadow_hsv = board_color_hsv - SHADOW_OFFSET;
+
+    // Consider shadow and color bands only near the table edges, so the cushion bands are computed as row spans
+    const int DEPTH_SHADOW_MASK = 50;
+    const int DEPTH_COLOR_MASK = 30;
+    get_shrinked_field_spans(cushion_distance, get_scaled_length(DEPTH_SHADOW_MASK, resolution_scale), shadow_shrinked_spans);
+    get_shrinked_field_spans(cushion_distance, get_scaled_length(DEPTH_COLOR_MASK, resolution_scale), color_shrinked_spans);
+
+    // Union of the board, shadows and color masks, each band evaluated only where it is considered
+    const hsv_range board_band = {board_color_hsv - Vec3b(5, 80, 50), board_color_hsv + Vec3b(5, 60, 15)};
+    const hsv_range shadow_band = {shadow_hsv - Vec3b(3, 30, 80), shadow_hsv + Vec3b(3, 100, 40)};
+    const hsv_range color_band = {board_color_hsv - Vec3b(10, 255, 150), shadow_hsv + Vec3b(10, 255, 255)};
+    const hsv_band_classifier interior_classifier({board_band});
+    const hsv_band_classifier shadow_band_classifier({board_band, shadow_band});
+    const hsv_band_classifier color_band_classifier({board_band, shadow_band, color_band});
+    classify_by_cushion_band(blurred_masked_hsv, interior_classifier, shadow_band_classifier, color_band_classifier, shadow_shrinked_spans, color_shrinked_spans, classified_mask);
 
     // Region growing to fine tune the mask
     const int HUE_THRESHOLD = 3;
     const int SATURATION_THRESHOLD = 6;
     const int VALUE_THRESHOLD = 4;
-    vector<Point> seed_points;
-    extract_seed_points(final_segmentation_mask, seed_points);
-    region_growing(blurred_masked_hsv, final_segmentation_mask, seed_points, HUE_THRESHOLD, SATURATION_THRESHOLD, VALUE_THRESHOLD);
-
-    // Closening operation to fine-tune the mask
-    const Size CLOSURE_SIZE = Size(3, 3);
-    morphologyEx(final_segmentation_mask.clone(), final_segmentation_mask, MORPH_CLOSE, getStructuringElement(MORPH_ELLIPSE, CLOSURE_SIZE));
+    region_grower.grow(blurred_masked_hsv, classified_mask, dst, HUE_THRESHOLD, SATURATION_THRESHOLD, VALUE_THRESHOLD);
 
+    // Closening, small holes filling and removal of the black component outside the current masking, which is able
+    // to remove hands and some holes from the masking
+    const int CLOSURE_SIZE = 3;
     const int AREA_THRESHOLD = 90;
-    fill_small_holes(final_segmentation_mask, AREA_THRESHOLD);
+    const int closure_size = get_scaled_filter_size(CLOSURE_SIZE, resolution_scale);
+    clean_up_segmentation_mask(dst, Size(closure_size, closure_size), AREA_THRESHOLD * resolution_scale * resolution_scale / (scale * scale), merge_corner);
+}
 
-    // Remove black component outside the current masking. This is able to remove hands and some holes from the masking.
-    Mat out_of_field_mask;
-    mask_region_growing(final_segmentation_mask, out_of_field_mask, {Point(0, 0)});
-    bitwise_or(final_segmentation_mask.clone(), out_of_field_mask, final_segmentation_mask);
+void balls_localizer::localize_coarse_to_fine(frame_context &context, int min_radius, int max_radius, int min_distance, Mat &blurred_masked_hsv, Mat &src_masked_hsv, Mat &segmentation_mask, vector<Vec3f> &circles)
+{
+    const int SCALE = 1 << options.pyramid_levels;
+    const Mat &coarse_hsv = context.get_pyramid_hsv(options.pyramid_levels);
+
+    // Playing field at the coarse resolution, keeping the full resolution cushion distance values
+    Mat coarse_field_mask, coarse_cushion_distance;
+    resize(table_field.mask, coarse_field_mask, coarse_hsv.size(), 0, 0, INTER_NEAREST);
+    resize(table_field.cushion_distance, coarse_cushion_distance, coarse_hsv.size(), 0, 0, INTER_NEAREST);
+
+    // The pyramid levels are already low pass filtered, so they are segmented without further blurring
+    Mat coarse_masked_hsv, coarse_segmentation_mask;
+    coarse_hsv.copyTo(coarse_masked_hsv, coarse_field_mask);
+    const int RADIUS = 100;
+    const Point CENTER = Point(coarse_masked_hsv.cols / 2, coarse_masked_hsv.rows / 2);
+    const Vec3b board_color_hsv = color_estimator.estimate(coarse_masked_hsv, CENTER, get_scaled_length(RADIUS, resolution_scale / SCALE), Mat(), median_estimate);
+    segment_balls(coarse_masked_hsv, coarse_cushion_distance, board_color_hsv, SCALE, true, coarse_segmentation_mask);
+
+    vector<Vec3f> coarse_circles;
+    const int COARSE_MIN_RADIUS = max(min_radius / SCALE, 1);
+    const int COARSE_MAX_RADIUS = max((max_radius + SCALE - 1) / SCALE, COARSE_MIN_RADIUS);
+    const int COARSE_MIN_DISTANCE = max(min_distance / SCALE, 1);
+    generate_candidates(coarse_segmentation_mask, COARSE_MIN_RADIUS, COARSE_MAX_RADIUS, COARSE_MIN_DISTANCE, SCALE, coarse_circles);
+
+    // Full resolution images, filled only within the windows of the candidates
+    const Mat &src = context.get_frame();
+    blurred_masked_hsv.create(src.size(), CV_8UC3);
+    blurred_masked_hsv.setTo(Scalar(0, 0, 0));
+    src_masked_hsv.create(src.size(), CV_8UC3);
+    src_masked_hsv.setTo(Scalar(0, 0, 0));
+    segmentation_mask.create(src.size(), CV_8U);
+    segmentation_mask.setTo(255);
+
+    // The window holds the largest ball centered anywhere in the reach of the coarse center
+    const int WINDOW_HALF_SIZE = 2 * max_radius;
+    const int FILTER_SIZE = 3;
+    const int FILTER_SIGMA = 3;
+    const int filter_size = get_scaled_filter_size(FILTER_SIZE, resolution_scale);
+    const Rect FRAME_RECT = Rect(Point(0, 0), src.size());
+    circles.clear();
+    for (const Vec3f &coarse_circle : coarse_circles)
+    {
+        const Point center = Point(cvRound(coarse_circle[0] * SCALE), cvRound(coarse_circle[1] * SCALE));
+        const Rect window = Rect(center - Point(WINDOW_HALF_SIZE, WINDOW_HALF_SIZE), center + Point(WINDOW_HALF_SIZE + 1, WINDOW_HALF_SIZE + 1)) & FRAME_RECT;
+        if (window.empty())
+            continue;
+
+        // Filtering the window sees the pixels of the frame around it, as filtering the whole frame does
+        Mat window_blurred, window_blurred_hsv, window_hsv;
+        GaussianBlur(src(window), window_blurred, Size(filter_size, filter_size), FILTER_SIGMA * resolution_scale, FILTER_SIGMA * resolution_scale);
+        cvtColor(window_blurred, window_blurred_hsv, COLOR_BGR2HSV);
+        cvtColor(src(window), window_hsv, COLOR_BGR2HSV);
+
+        const Mat window_field_mask = table_field.mask(window);
+        Mat window_masked_hsv = blurred_masked_hsv(window);
+        window_blurred_hsv.copyTo(window_masked_hsv, window_field_mask);
+        Mat window_src_masked_hsv = src_masked_hsv(window);
+        window_hsv.copyTo(window_src_masked_hsv, window_field_mask);
+
+        // The corner of the window may lie on a ball, so the background out of the field is merged by the field mask
+        Mat window_mask, out_of_field;
+        segment_balls(window_masked_hsv, table_field.cushion_distance(window), board_color_hsv, 1, false, window_mask);
+        bitwise_not(window_field_mask, out_of_field);
+        window_mask.setTo(255, out_of_field);
+
+        // Overlapping windows keep the balls of both
+        Mat window_segmentation_mask = segmentation_mask(window);
+        bitwise_and(window_segmentation_mask, window_mask, window_segmentation_mask);
+
+        // The deepest pixel of the blob within the reach of the coarse center is the refined center
+        Mat blobs, distance;
+        bitwise_not(window_mask, blobs);
+        distanceTransform(blobs, distance, DIST_L2, DIST_MASK_PRECISE);
+        const Point window_center = center - window.tl();
+        const Rect reach = Rect(window_center - Point(SCALE, SCALE), window_center + Point(SCALE + 1, SCALE + 1)) & Rect(Point(0, 0), window.size());
+
+        Vec3f circle = Vec3f(center.x, center.y, coarse_circle[2] * SCALE);
+        double depth = 0;
+        Point deepest;
+        if (!reach.empty())
+            minMaxLoc(distance(reach), nullptr, &depth, nullptr, &deepest);
+
+        const float MIN_DEPTH = 1;
+        if (depth >= MIN_DEPTH)
+        {
+            circle[0] = window.x + reach.x + deepest.x;
+            circle[1] = window.y + reach.y + deepest.y;
+            circle[2] = depth;
+        }
+
+        int band_min, band_max;
+        get_ball_radius_band(circle[1], circle[1], min_radius, max_radius, 1, band_min, band_max);
+        circle[2] = min(max(circle[2], static_cast<float>(band_min)), static_cast<float>(band_max));
+        circles.push_back(circle);
+    }
+}
 
-    const int HOUGH_MIN_RADIUS = 8;
-    const int HOUGH_MAX_RADIUS = 16;
+void balls_localizer::map_circles_to_frame(vector<Vec3f> &circles)
+{
+    if (rectification.empty())
+    {
+        for (Vec3f &circle : circles)
+        {
+            circle[0] += table_box.x;
+            circle[1] += table_box.y;
+        }
+        return;
+    }
+
+    if (circles.empty())
+        return;
+
+    vector<Point2f> centers;
+    for (const Vec3f &circle : circles)
+        centers.push_back(Point2f(circle[0], circle[1]));
+    perspectiveTransform(centers, centers, rectification.inv());
+
+    for (int i = 0; i < circles.size(); i++)
+    {
+        // Length in the rectified table of one frame pixel along the row
+        const Point2f center = centers.at(i);
+        vector<Point2f> row_step = {center - Point2f(0.5, 0), center + Point2f(0.5, 0)};
+        perspectiveTransform(row_step, row_step, rectification);
+        const double step_length = norm(row_step.at(1) - row_step.at(0));
+
+        const float radius = step_length > 0 ? circles.at(i)[2] / step_length : circles.at(i)[2];
+        circles.at(i) = Vec3f(center.x, center.y, radius);
+    }
+}
+
+const Mat &balls_localizer::get_disk_stencil(int radius)
+{
+    auto stencil = disk_stencils.find(radius);
+    if (stencil != disk_stencils.end())
+        return stencil->second;
+
+    // The disk is drawn with the same rasterization of a full image circle, so that patch results are identical.
+    Mat disk = Mat::zeros(2 * radius + 1, 2 * radius + 1, CV_8U);
+    const Scalar WHITE = Scalar(255);
+    circle(disk, Point(radius, radius), radius, WHITE, FILLED);
+    return disk_stencils.emplace(radius, disk).first->second;
+}
+
+bool balls_localizer::get_circle_patch(Point center, int radius, Size image_size, Rect &image_roi, Rect &stencil_roi)
+{
+    Rect circle_rect(center.x - radius, center.y - radius, 2 * radius + 1, 2 * radius + 1);
+    image_roi = circle_rect & Rect(Point(0, 0), image_size);
+    stencil_roi = image_roi - circle_rect.tl();
+    return !image_roi.empty();
+}
+
+void balls_localizer::generate_candidates(const Mat &segmentation_mask, int min_radius, int max_radius, int min_distance, int scale, vector<Vec3f> &circles)
+{
+    switch (options.generator)
+    {
+    case distance_transform_generator:
+        generate_distance_transform_candidates(segmentation_mask, min_radius, max_radius, min_distance, scale, circles);
+        break;
+    case hough_generator:
+    default:
+        generate_hough_candidates(segmentation_mask, min_radius, max_radius, min_distance, scale, circles);
+        break;
+    }
+}
+
+void balls_localizer::get_ball_radius_band(int first_row, int last_row, int min_radius, int max_radius, int scale, int &band_min, int &band_max)
+{
+    band_min = min_radius;
+    band_max = max_radius;
+    const vector<float> &ball_radius_by_row = table_field.ball_radius_by_row;
+    if (ball_radius_by_row.empty())
+        return;
+
+    // The rows of the radius model are full resolution rows
+    first_row = max(first_row * scale, 0);
+    last_row = min(last_row * scale + scale - 1, static_cast<int>(ball_radius_by_row.size()) - 1);
+    if (first_row > last_row)
+        return;
+
+    auto expected_range = minmax_element(ball_radius_by_row.begin() + first_row, ball_radius_by_row.begin() + last_row + 1);
+
+    const float LOWER_BAND_FACTOR = 0.75;
+    const float UPPER_BAND_FACTOR = 1.25;
+    band_min = min(max(static_cast<int>(floor(*expected_range.first * LOWER_BAND_FACTOR / scale)), min_radius), max_radius);
+    band_max = max(min(static_cast<int>(ceil(*expected_range.second * UPPER_BAND_FACTOR / scale)), max_radius), band_min);
+}
+
+void balls_localizer::generate_hough_candidates(const Mat &segmentation_mask, int min_radius, int max_radius, int min_distance, int scale, vector<Vec3f> &circles)
+{
     const float HOUGH_DP = 0.3;
-    const int HOUGH_MIN_DISTANCE = 15;
     const int HOUGH_CANNY_PARAM = 100;
     const int HOUGH_MIN_VOTES = 5;
-    vector<Vec3f> circles;
-    HoughCircles(final_segmentation_mask, circles, HOUGH_GRADIENT, HOUGH_DP, HOUGH_MIN_DISTANCE, HOUGH_CANNY_PARAM, HOUGH_MIN_VOTES, HOUGH_MIN_RADIUS, HOUGH_MAX_RADIUS);
+    const int hough_min_votes = get_scaled_length(HOUGH_MIN_VOTES, resolution_scale);
 
-    vector<Mat> hough_circle_masks;
-    circles_masks(circles, hough_circle_masks, src.size());
+    // A single transform searches the radii of the bands of all the rows, then each circle is kept if its radius is
+    // within the band of its row
+    int band_min, band_max;
+    get_ball_radius_band(0, segmentation_mask.rows - 1, min_radius, max_radius, scale, band_min, band_max);
+    vector<Vec3f> hough_circles;
+    HoughCircles(segmentation_mask, hough_circles, HOUGH_GRADIENT, HOUGH_DP, min_distance, HOUGH_CANNY_PARAM, hough_min_votes, band_min, band_max);
 
-    // Circle filtering to remove wrongly detected circles by the transform.
-    const float MAX_INTERSECTION = 0.60;
-    const float MAX_DISTANCE_OUT_OF_BOUNDS = 20;
-    const float MIN_DISTANCE_FROM_HOLE = 27;
-    const float MIN_DISSIMILAR_NEIGHBORDHOOD_DISTANCE = 25;
-    const float MIN_DISSIMILAR_VERTICAL_DISTANCE = 25;
-    const float MIN_DISSIMILAR_RADIUS_DIFFERENCE = 2;
-    filter_empty_circles(circles, hough_circle_masks, final_segmentation_mask, MAX_INTERSECTION);
-    filter_out_of_bound_circles(circles, playing_field.mask, MAX_DISTANCE_OUT_OF_BOUNDS);
-    filter_near_holes_circles(circles, playing_field.hole_points, MIN_DISTANCE_FROM_HOLE);
-    filter_close_dissimilar_circles(circles, MIN_DISSIMILAR_NEIGHBORDHOOD_DISTANCE, MIN_DISSIMILAR_VERTICAL_DISTANCE, MIN_DISSIMILAR_RADIUS_DIFFERENCE);
+    circles.clear();
+    for (const Vec3f &circle : hough_circles)
+    {
+        const int row = min(max(cvRound(circle[1]), 0), segmentation_mask.rows - 1);
+        get_ball_radius_band(row, row, min_radius, max_radius, scale, band_min, band_max);
+        if (circle[2] >= band_min && circle[2] <= band_max)
+            circles.push_back(circle);
+    }
+}
+
+void balls_localizer::generate_distance_transform_candidates(const Mat &segmentation_mask, int min_radius, int max_radius, int min_distance, int scale, vector<Vec3f> &circles)
+{
+    if (segmentation_mask.type() != CV_8UC1)
+    {
+        const string INVALID_MASK = "Argument does not represent a mask.";
+        throw invalid_argument(INVALID_MASK);
+    }
 
-    // Ball classification among detected circles
-    find_cue_ball(blurred_masked, final_segmentation_mask, circles);
-    find_black_ball(blurred_masked, final_segmentation_mask, circles);
-    find_stripe_balls(src_masked, final_segmentation_mask, circles);
-    find_solid_balls(blurred_masked, final_segmentation_mask, circles);
+    // Distance of the pixels of the ball blobs from the playing field
+    Mat blobs, distance, dilated_distance;
+    bitwise_not(segmentation_mask, blobs);
+    distanceTransform(blobs, distance, DIST_L2, DIST_MASK_PRECISE);
+    dilate(distance, dilated_distance, Mat());
 
-    get_bounding_boxes(circles, bounding_boxes);
+    /*
+        Local maxima of the distance are the centers of the blobs. Occluded balls have shallower centers,
+        while blobs with deeper centers are too large to be balls.
+    */
+    const float MIN_CENTER_DEPTH_FACTOR = 0.75;
+    const float MAX_CENTER_DEPTH_FACTOR = 1.25;
+    vector<Vec3f> centers;
+    for (int row = 0; row < distance.rows; row++)
+    {
+        int band_min, band_max;
+        get_ball_radius_band(row, row, min_radius, max_radius, scale, band_min, band_max);
+        const float MIN_CENTER_DEPTH = MIN_CENTER_DEPTH_FACTOR * band_min;
+        const float MAX_CENTER_DEPTH = MAX_CENTER_DEPTH_FACTOR * band_max;
+
+        const float *distance_row = distance.ptr<float>(row);
+        const float *dilated_distance_row = dilated_distance.ptr<float>(row);
+        for (int col = 0; col < distance.cols; col++)
+        {
+            const float depth = distance_row[col];
+            if (depth >= MIN_CENTER_DEPTH && depth <= MAX_CENTER_DEPTH && depth >= dilated_distance_row[col])
+                centers.push_back(Vec3f(col, row, depth));
+        }
+    }
+
+    // Non maxima suppression, the deepest centers first
+    stable_sort(centers.begin(), centers.end(), [](const Vec3f &lhs, const Vec3f &rhs)
+                { return lhs[2] > rhs[2]; });
+
+    circles.clear();
+    for (const Vec3f &center : centers)
+    {
+        bool is_suppressed = false;
+        for (const Vec3f &circle : circles)
+        {
+            if (norm(Point2f(center[0], center[1]) - Point2f(circle[0], circle[1])) < min_distance)
+            {
+                is_suppressed = true;
+                break;
+            }
+        }
+
+        if (!is_suppressed)
+        {
+            int band_min, band_max;
+            get_ball_radius_band(center[1], center[1], min_radius, max_radius, scale, band_min, band_max);
+            circles.push_back(Vec3f(center[0], center[1], min(max(center[2], static_cast<float>(band_min)), static_cast<float>(band_max))));
+        }
+    }
 }
 
-void balls_localizer::circles_masks(const vector<Vec3f> &circles, vector<Mat> &masks, Size mask_size)
+void balls_localizer::get_shrinked_field_spans(const Mat &cushion_distance, int depth, vector<vector<Range>> &shrinked_spans)
 {
-    masks.clear();
-    for (size_t i = 0; i < circles.size(); i++)
+    if (cushion_distance.type() != CV_16UC1)
     {
-        Mat mask(mask_size, CV_8U);
-        mask.setTo(Scalar(0));
-        const Scalar WHITE = Scalar(255);
-        circle(mask, Point(circles.at(i)[0], circles.at(i)[1]), circles.at(i)[2], WHITE, FILLED);
-        masks.push_back(mask);
+        const string INVALID_DISTANCE = "Argument does not represent a cushion distance.";
+        throw invalid_argument(INVALID_DISTANCE);
+    }
+
+    // Spans of reused vectors keep their capacity between frames
+    const ushort MIN_DISTANCE = (depth + 1) / 2;
+    shrinked_spans.resize(cushion_distance.rows);
+    for (int row = 0; row < cushion_distance.rows; row++)
+    {
+        shrinked_spans[row].clear();
+        const ushort *distance_row = cushion_distance.ptr<ushort>(row);
+        int span_start = -1;
+        for (int col = 0; col < cushion_distance.cols; col++)
+        {
+            const bool is_kept = distance_row[col] >= MIN_DISTANCE;
+            if (is_kept && span_start < 0)
+                span_start = col;
+            else if (!is_kept && span_start >= 0)
+            {
+                shrinked_spans[row].push_back(Range(span_start, col));
+                span_start = -1;
+            }
+        }
+
+        if (span_start >= 0)
+            shrinked_spans[row].push_back(Range(span_start, cushion_distance.cols));
     }
 }
 
-void balls_localizer::filter_empty_circles(vector<Vec3f> &circles, const vector<Mat> &masks, const Mat &segmentation_mask, float intersection_threshold)
+void balls_localizer::classify_by_cushion_band(const Mat &hsv, const hsv_band_classifier &interior_classifier, const hsv_band_classifier &shadow_band_classifier, const hsv_band_classifier &color_band_classifier, const vector<vector<Range>> &shadow_shrinked_spans, const vector<vector<Range>> &color_shrinked_spans, Mat &dst)
+{
+    if (hsv.type() != CV_8UC3 || shadow_shrinked_spans.size() != hsv.rows || color_shrinked_spans.size() != hsv.rows)
+    {
+        const string INVALID_ARGUMENTS = "Invalid HSV image or cushion band spans.";
+        throw invalid_argument(INVALID_ARGUMENTS);
+    }
+
+    dst.create(hsv.size(), CV_8U);
+    for (int row = 0; row < hsv.rows; row++)
+    {
+        const uchar *hsv_row = hsv.ptr<uchar>(row);
+        uchar *dst_row = dst.ptr<uchar>(row);
+
+        /*
+            The shadow band is deeper than the color band, so each shadow shrinked span lies within a color shrinked
+            span. The row alternates color band, shadow band, interior, shadow band and color band segments.
+        */
+        int col = 0;
+        int shadow_span_index = 0;
+        const vector<Range> &shadow_spans = shadow_shrinked_spans[row];
+        for (const Range &color_span : color_shrinked_spans[row])
+        {
+            color_band_classifier.classify_row(hsv_row + 3 * col, nullptr, dst_row + col, color_span.start - col);
+            col = color_span.start;
+
+            for (; shadow_span_index < shadow_spans.size() && shadow_spans[shadow_span_index].end <= color_span.end; shadow_span_index++)
+            {
+                const Range &shadow_span = shadow_spans[shadow_span_index];
+                shadow_band_classifier.classify_row(hsv_row + 3 * col, nullptr, dst_row + col, shadow_span.start - col);
+                interior_classifier.classify_row(hsv_row + 3 * shadow_span.start, nullptr, dst_row + shadow_span.start, shadow_span.size());
+                col = shadow_span.end;
+            }
+
+            shadow_band_classifier.classify_row(hsv_row + 3 * col, nullptr, dst_row + col, color_span.end - col);
+            col = color_span.end;
+        }
+
+        color_band_classifier.classify_row(hsv_row + 3 * col, nullptr, dst_row + col, hsv.cols - col);
+    }
+}
+
+void balls_localizer::filter_empty_circles(const vector<Vec3f> &circles, const Mat &segmentation_mask, float intersection_threshold, vector<bool> &rejected)
 {
     if (segmentation_mask.type() != CV_8UC1)
     {
@@ -159,68 +687,93 @@ void balls_localizer::filter_empty_circles(vector<Vec3f> &circles, const vector<
         throw invalid_argument(INVALID_MASK);
     }
 
-    vector<Vec3f> filtered_circles;
-    for (size_t i = 0; i < circles.size(); i++)
+    for (int i = 0; i < circles.size(); i++)
     {
+        if (rejected[i])
+            continue;
+
+        const Vec3f &circle = circles[i];
+        Point center(static_cast<int>(circle[0]), static_cast<int>(circle[1]));
+        int radius = static_cast<int>(circle[2]);
+
+        // Circles completely out of the image have no area, therefore they are discarded.
+        Rect image_roi, stencil_roi;
+        if (!get_circle_patch(center, radius, segmentation_mask.size(), image_roi, stencil_roi))
+        {
+            rejected[i] = true;
+            continue;
+        }
+
         /*
             Compute the ratio of the circle which is empty, i.e. that contains a large portion
             of segmentation mask. In fact, if a circle contains such large portion, it is probably been
-            wrongly detected by Hough transform.
+            wrongly detected by Hough transform. Only the circle patch is visited.
         */
-        float circle_area = static_cast<float>(countNonZero(masks[i]));
-        Mat masks_intersection;
-        bitwise_and(masks[i], segmentation_mask, masks_intersection);
-        float intersection_area = static_cast<float>(countNonZero(masks_intersection));
+        const Mat stencil = get_disk_stencil(radius)(stencil_roi);
+        const Mat patch = segmentation_mask(image_roi);
+        int circle_area = 0;
+        int intersection_area = 0;
+        for (int row = 0; row < patch.rows; row++)
+        {
+            const uchar *stencil_row = stencil.ptr<uchar>(row);
+            const uchar *patch_row = patch.ptr<uchar>(row);
+            for (int col = 0; col < patch.cols; col++)
+            {
+                if (stencil_row[col] != 0)
+                {
+                    circle_area++;
+                    if (patch_row[col] != 0)
+                        intersection_area++;
+                }
+            }
+        }
 
-        if (intersection_area / circle_area < intersection_threshold)
-            filtered_circles.push_back(circles.at(i));
+        if (static_cast<float>(intersection_area) / static_cast<float>(circle_area) >= intersection_threshold)
+            rejected[i] = true;
     }
-    circles = filtered_circles;
 }
 
-void balls_localizer::filter_out_of_bound_circles(vector<Vec3f> &circles, const Mat &table_mask, int distance_threshold)
+void balls_localizer::filter_out_of_bound_circles(const vector<Vec3f> &circles, const Mat &cushion_distance, int distance_threshold, vector<bool> &rejected)
 {
-    if (table_mask.type() != CV_8UC1)
+    if (cushion_distance.type() != CV_16UC1)
     {
-        const string INVALID_MASK = "Argument does not represent a mask.";
-        throw invalid_argument(INVALID_MASK);
+        const string INVALID_DISTANCE = "Argument does not represent a cushion distance.";
+        throw invalid_argument(INVALID_DISTANCE);
     }
-    vector<Vec3f> filtered_circles;
-    Mat shrinked_table_mask;
-    const int WHITE = 255;
 
-    // Erode the table to exclude false positives in the table border
-    erode(table_mask, shrinked_table_mask, getStructuringElement(MORPH_CROSS, Size(distance_threshold, distance_threshold)));
+    // Exclude false positives in the table border, as an erosion of the table would do
+    const ushort MIN_DISTANCE = (distance_threshold + 1) / 2;
 
-    for (Vec3f circle : circles)
+    for (int i = 0; i < circles.size(); i++)
     {
-        Point center = Point(circle[0], circle[1]);
-        // Keep the center only if it is inside the mask, i.e. not out of bounds
-        if (shrinked_table_mask.at<uchar>(center) == WHITE)
-            filtered_circles.push_back(circle);
+        if (rejected[i])
+            continue;
+
+        Point center = Point(circles[i][0], circles[i][1]);
+        // Keep the center only if it is deep enough inside the table, i.e. not out of bounds
+        if (!Rect(Point(0, 0), cushion_distance.size()).contains(center) || cushion_distance.at<ushort>(center) < MIN_DISTANCE)
+            rejected[i] = true;
     }
-    circles = filtered_circles;
 }
 
-void balls_localizer::filter_near_holes_circles(vector<Vec3f> &circles, const vector<Point> &holes_points, float distance_threshold)
+void balls_localizer::filter_near_holes_circles(const vector<Vec3f> &circles, const circle_grid &grid, const vector<Point> &holes_points, float distance_threshold, vector<bool> &rejected)
 {
-    vector<Vec3f> filtered_circles;
-    for (const Vec3f circle : circles)
+    vector<int> neighbors;
+    for (Point hole_point : holes_points)
     {
-        Point circle_point = Point(static_cast<int>(circle[0]), static_cast<int>(circle[1]));
-
-        // Remove the circle if it is too close to the hole.
-        bool keep_circle = true;
-        for (Point hole_point : holes_points)
+        grid.query(hole_point, distance_threshold, neighbors);
+        for (int i : neighbors)
         {
+            if (rejected[i])
+                continue;
+
+            Point circle_point = Point(static_cast<int>(circles[i][0]), static_cast<int>(circles[i][1]));
+
+            // Remove the circle if it is too close to the hole.
             if (norm(hole_point - circle_point) < distance_threshold)
-                keep_circle = false;
+                rejected[i] = true;
         }
-
-        if (keep_circle)
-            filtered_circles.push_back(circle);
     }
-    circles = filtered_circles;
 }
 
 void balls_localizer::get_bounding_boxes(const vector<Vec3f> &circles, vector<Rect> &bounding_boxes)
@@ -263,7 +816,7 @@ cv::Rect balls_localizer::get_bounding_box(cv::Vec3f circle)
     return Rect(x, y, width, height);
 }
 
-void balls_localizer::fill_small_holes(Mat &binary_mask, double area_threshold)
+void balls_localizer::clean_up_segmentation_mask(Mat &binary_mask, Size closure_size, double area_threshold, bool merge_corner)
 {
     if (binary_mask.type() != CV_8UC1)
     {
@@ -271,61 +824,67 @@ void balls_localizer::fill_small_holes(Mat &binary_mask, double area_threshold)
         throw invalid_argument(INVALID_MASK);
     }
 
-    vector<vector<Point>> contours;
-    vector<Vec4i> hierarchy;
-    findContours(binary_mask, contours, hierarchy, RETR_CCOMP, CHAIN_APPROX_SIMPLE);
-
-    // Fills hole of components with area smaller than area_threshold
-    for (int i = 0; i < contours.size(); ++i)
-    {
-        double area = contourArea(contours[i]);
-        if (area < area_threshold)
-            drawContours(binary_mask, contours, i, Scalar(255), FILLED, 8, hierarchy, 1); // Fills the hole
-    }
-}
-
-void balls_localizer::extract_seed_points(const Mat &inrange_segmentation_mask, vector<Point> &seed_points)
-{
-    if (inrange_segmentation_mask.type() != CV_8UC1)
-    {
-        const string INVALID_MASK = "Argument does not represent a mask.";
-        throw invalid_argument(INVALID_MASK);
-    }
-
-    seed_points.clear();
-
-    // Take as seed point every white pixel in the mask
-    for (int y = 0; y < inrange_segmentation_mask.rows; ++y)
+    Mat closed_mask;
+    morphologyEx(binary_mask, closed_mask, MORPH_CLOSE, getStructuringElement(MORPH_ELLIPSE, closure_size));
+
+    // Holes of 8-connected components are 4-connected components of the background
+    Mat background, labels, stats, centroids;
+    bitwise_not(closed_mask, background);
+    const int components = connectedComponentsWithStats(background, labels, stats, centroids, 4, CV_32S);
+
+    // Fill the holes whose contour encloses an area smaller than area_threshold. The contour of a hole only depends on
+    // the mask pixels around it and on their neighbors, so it is traced within a margin of two pixels from the hole
+    const int MARGIN = 2;
+    const Rect MASK_RECT = Rect(Point(0, 0), closed_mask.size());
+    vector<vector<Point>> hole_contours;
+    vector<Vec4i> hole_hierarchy;
+    vector<uchar> is_filled(components, 0);
+    for (int label = 1; label < components; label++)
     {
-        for (int x = 0; x < inrange_segmentation_mask.cols; ++x)
+        const int left = stats.at<int>(label, CC_STAT_LEFT);
+        const int top = stats.at<int>(label, CC_STAT_TOP);
+        const int width = stats.at<int>(label, CC_STAT_WIDTH);
+        const int height = stats.at<int>(label, CC_STAT_HEIGHT);
+        const bool is_hole = left > 0 && top > 0 && left + width < closed_mask.cols && top + height < closed_mask.rows;
+
+        // The contour encloses the pixels of the hole, so it is not traced for holes of at least area_threshold pixels
+        if (!is_hole || stats.at<int>(label, CC_STAT_AREA) >= area_threshold)
+            continue;
+
+        const Rect neighborhood = Rect(left - MARGIN, top - MARGIN, width + 2 * MARGIN, height + 2 * MARGIN) & MASK_RECT;
+        findContours(closed_mask(neighborhood), hole_contours, hole_hierarchy, RETR_CCOMP, CHAIN_APPROX_SIMPLE);
+
+        // The contour of the hole is the innermost hole contour around a pixel of the hole, taken on its top row
+        const int *top_labels_row = labels.ptr<int>(top);
+        int hole_col = left;
+        while (top_labels_row[hole_col] != label)
+            hole_col++;
+        const Point2f hole_pixel(hole_col - neighborhood.x, top - neighborhood.y);
+
+        double contour_area = DBL_MAX;
+        for (size_t i = 0; i < hole_contours.size(); i++)
         {
-            if (inrange_segmentation_mask.at<uchar>(y, x) > 0)
-                seed_points.push_back(Point(x, y));
+            if (hole_hierarchy[i][3] >= 0 && pointPolygonTest(hole_contours[i], hole_pixel, false) > 0)
+                contour_area = min(contour_area, contourArea(hole_contours[i]));
         }
+        is_filled[label] = contour_area < area_threshold;
     }
-}
 
-void balls_localizer::get_circle_and_field_mask(const cv::Mat &segmentation_mask, cv::Vec3f circle, cv::Mat &mask)
-{
-    if (segmentation_mask.type() != CV_8UC1 || mask.type() != CV_8UC1)
+    // Merge the background component of the top left corner
+    if (merge_corner && closed_mask.at<uchar>(0, 0) == 0)
+        is_filled[labels.at<int>(0, 0)] = 1;
+
+    for (int row = 0; row < closed_mask.rows; row++)
     {
-        const string INVALID_MASK = "Argument does not represent a mask.";
-        throw invalid_argument(INVALID_MASK);
+        const uchar *mask_row = closed_mask.ptr<uchar>(row);
+        const int *labels_row = labels.ptr<int>(row);
+        uchar *binary_mask_row = binary_mask.ptr<uchar>(row);
+        for (int col = 0; col < closed_mask.cols; col++)
+            binary_mask_row[col] = (mask_row[col] != 0 || is_filled[labels_row[col]]) ? 255 : 0;
     }
-
-    int x = cvRound(circle[0]);
-    int y = cvRound(circle[1]);
-    int radius = cvRound(circle[2]);
-
-    // Create as mask as the intersection of the circle mask and of the ball segmentation mask
-    mask = Mat::zeros(segmentation_mask.size(), CV_8U);
-    cv::circle(mask, Point(x, y), radius, Scalar(255), FILLED);
-    Mat balls_segmentation_mask;
-    bitwise_not(segmentation_mask, balls_segmentation_mask); // Negate it as the original mask masks out the balls
-    bitwise_and(mask, balls_segmentation_mask, mask);
 }
 
-float balls_localizer::get_white_ratio_in_circle_cue(const Mat &src, const Mat &segmentation_mask, Vec3f circle)
+void balls_localizer::extract_ball_features(const Mat &blurred_hsv, const Mat &src_hsv, const Mat &segmentation_mask, const vector<Vec3f> &circles, vector<ball_features> &features)
 {
     if (segmentation_mask.type() != CV_8UC1)
     {
@@ -333,68 +892,114 @@ float balls_localizer::get_white_ratio_in_circle_cue(const Mat &src, const Mat &
         throw invalid_argument(INVALID_MASK);
     }
 
-    Mat src_hsv;
-    cvtColor(src, src_hsv, COLOR_BGR2HSV);
+    const Vec3b CUE_WHITE_HSV_LOWERBOUND = Vec3b(20, 0, 140);
+    const Vec3b CUE_WHITE_HSV_UPPERBOUND = Vec3b(110, 100, 255);
+    const Vec3b STRIPE_WHITE_HSV_LOWERBOUND = Vec3b(0, 0, 135);
+    const Vec3b STRIPE_WHITE_HSV_UPPERBOUND = Vec3b(120, 100, 255);
+    const Vec3b BLACK_HSV_LOWERBOUND = Vec3b(35, 1, 0);
+    const Vec3b BLACK_HSV_UPPERBOUND = Vec3b(140, 255, 90);
+    const double STRIPE_MIN_DIAMETER = 8; // Stripe white components with smaller diameter are noise.
 
-    Mat mask = Mat::zeros(src_hsv.size(), CV_8U);
-    get_circle_and_field_mask(segmentation_mask, circle, mask);
+    const hsv_band_classifier cue_white_classifier({{CUE_WHITE_HSV_LOWERBOUND, CUE_WHITE_HSV_UPPERBOUND}});
+    const hsv_band_classifier black_classifier({{BLACK_HSV_LOWERBOUND, BLACK_HSV_UPPERBOUND}});
+    const hsv_band_classifier stripe_white_classifier({{STRIPE_WHITE_HSV_LOWERBOUND, STRIPE_WHITE_HSV_UPPERBOUND}});
 
-    Mat masked_hsv;
-    src_hsv.copyTo(masked_hsv, mask);
+    features.clear();
+    Mat valid_mask;
+    Mat cue_white_mask;
+    Mat black_mask;
+    Mat stripe_white_mask;
+    for (const Vec3f &circle : circles)
+    {
+        ball_features circle_features = {0, 0, 0, 0, 0};
 
-    Mat white_mask;
-    const Vec3b WHITE_HSV_LOWERBOUND = Vec3b(20, 0, 140);
-    const Vec3b WHITE_HSV_UPPERBOUND = Vec3b(110, 100, 255);
-    inRange(masked_hsv, WHITE_HSV_LOWERBOUND, WHITE_HSV_UPPERBOUND, white_mask);
+        Point center(cvRound(circle[0]), cvRound(circle[1]));
+        int radius = cvRound(circle[2]);
+        Rect image_roi, stencil_roi;
+        if (!get_circle_patch(center, radius, segmentation_mask.size(), image_roi, stencil_roi))
+        {
+            features.push_back(circle_features);
+            continue;
+        }
 
-    // Compute white pixels ratio
-    int white_pixels = countNonZero(white_mask);
-    int total_circle_pixels = countNonZero(mask);
-    double white_ratio = static_cast<double>(white_pixels) / total_circle_pixels;
+        /*
+            Visit once the pixels of the circle not belonging to the segmentation mask (the mask masks out
+            the balls), collecting all the features needed by the classifiers. The valid pixels restrict
+            the band classification of each row.
+        */
+        const Mat stencil = get_disk_stencil(radius)(stencil_roi);
+        const Mat segmentation_patch = segmentation_mask(image_roi);
+        const Mat blurred_patch = blurred_hsv(image_roi);
+        const Mat src_patch = src_hsv(image_roi);
+        valid_mask.create(image_roi.size(), CV_8U);
+        cue_white_mask.create(image_roi.size(), CV_8U);
+        black_mask.create(image_roi.size(), CV_8U);
+        stripe_white_mask.create(image_roi.size(), CV_8U);
+
+        long hue_sum = 0;
+        for (int row = 0; row < image_roi.height; row++)
+        {
+            const uchar *stencil_row = stencil.ptr<uchar>(row);
+            const uchar *segmentation_row = segmentation_patch.ptr<uchar>(row);
+            const uchar *blurred_row = blurred_patch.ptr<uchar>(row);
+            uchar *valid_row = valid_mask.ptr<uchar>(row);
 
-    return white_ratio;
-}
+            for (int col = 0; col < image_roi.width; col++)
+            {
+                valid_row[col] = (stencil_row[col] != 0 && segmentation_row[col] == 0) ? 255 : 0;
+                if (valid_row[col] == 0)
+                    continue;
 
-float balls_localizer::get_black_ratio_in_circle(const Mat &src, const Mat &segmentation_mask, Vec3f circle)
-{
-    if (segmentation_mask.type() != CV_8UC1)
-    {
-        const string INVALID_MASK = "Argument does not represent a mask.";
-        throw invalid_argument(INVALID_MASK);
-    }
+                circle_features.valid_pixels++;
+                hue_sum += blurred_row[3 * col];
+            }
+
+            const uchar *valid_rows[] = {valid_row};
+            cue_white_classifier.classify_row(blurred_row, valid_rows, cue_white_mask.ptr<uchar>(row), image_roi.width);
+            black_classifier.classify_row(blurred_row, valid_rows, black_mask.ptr<uchar>(row), image_roi.width);
+            stripe_white_classifier.classify_row(src_patch.ptr<uchar>(row), valid_rows, stripe_white_mask.ptr<uchar>(row), image_roi.width);
+        }
 
-    Mat src_hsv;
-    cvtColor(src, src_hsv, COLOR_BGR2HSV);
+        circle_features.cue_white_pixels = countNonZero(cue_white_mask);
+        circle_features.black_pixels = countNonZero(black_mask);
 
-    Mat mask = Mat::zeros(src.size(), CV_8U);
-    get_circle_and_field_mask(segmentation_mask, circle, mask);
+        // Remove stripe white components with small diameter
+        remove_connected_components_by_diameter(stripe_white_mask, STRIPE_MIN_DIAMETER * resolution_scale);
+        circle_features.stripe_white_pixels = countNonZero(stripe_white_mask);
 
-    Mat masked_hsv;
-    src_hsv.copyTo(masked_hsv, mask);
+        if (circle_features.valid_pixels > 0)
+            circle_features.mean_hue = static_cast<float>(static_cast<double>(hue_sum) / circle_features.valid_pixels);
 
-    Mat black_mask;
-    const Vec3b BLACK_HSV_LOWERBOUND = Vec3b(35, 1, 0);
-    const Vec3b BLACK_HSV_UPPERBOUND = Vec3b(140, 255, 90);
-    inRange(masked_hsv, BLACK_HSV_LOWERBOUND, BLACK_HSV_UPPERBOUND, black_mask);
+        features.push_back(circle_features);
+    }
+}
 
-    // Computing ratio
-    int black_pixels = countNonZero(black_mask);
-    int total_circle_pixels = countNonZero(mask);
-    double percentage_black = static_cast<double>(black_pixels) / total_circle_pixels;
+float balls_localizer::get_white_ratio_in_circle_cue(const ball_features &features)
+{
+    return static_cast<double>(features.cue_white_pixels) / features.valid_pixels;
+}
 
-    return percentage_black;
+float balls_localizer::get_black_ratio_in_circle(const ball_features &features)
+{
+    return static_cast<double>(features.black_pixels) / features.valid_pixels;
 }
 
-void balls_localizer::filter_close_dissimilar_circles(vector<Vec3f> &circles, float neighborhood_distance_threshold, float distance_threshold, float radius_threshold)
+void balls_localizer::filter_close_dissimilar_circles(const vector<Vec3f> &circles, const circle_grid &grid, float neighborhood_distance_threshold, float distance_threshold, float radius_threshold, vector<bool> &rejected)
 {
+    // Circles rejected by this filter are still compared with the others
     vector<bool> to_remove(circles.size(), false);
 
+    vector<int> neighbors;
     for (size_t i = 0; i < circles.size(); ++i)
     {
-        for (size_t j = 0; j < circles.size(); ++j)
+        if (rejected[i])
+            continue;
+
+        grid.query(Point2f(circles.at(i)[0], circles.at(i)[1]), neighborhood_distance_threshold, neighbors);
+        for (int j : neighbors)
         {
             // Consider only circles close enough
-            if (i != j && norm(circles.at(i) - circles.at(j)) < neighborhood_distance_threshold)
+            if (i != j && !rejected[j] && norm(circles.at(i) - circles.at(j)) < neighborhood_distance_threshold)
             {
                 float y1 = circles.at(i)[1];
                 float radius_1 = circles.at(i)[2];
@@ -408,14 +1013,11 @@ void balls_localizer::filter_close_dissimilar_circles(vector<Vec3f> &circles, fl
         }
     }
 
-    vector<Vec3f> filtered_circles;
     for (int i = 0; i < circles.size(); i++)
     {
-        if (!to_remove[i])
-            filtered_circles.push_back(circles.at(i));
+        if (to_remove[i])
+            rejected[i] = true;
     }
-
-    circles = filtered_circles;
 }
 
 void balls_localizer::draw_circles(const cv::Mat &src, cv::Mat &dst, vector<cv::Vec3f> &circles)
@@ -439,102 +1041,109 @@ void balls_localizer::remove_connected_components_by_diameter(Mat &mask, double
     }
 
     Mat labels, stats, centroids;
-    int number_labels = cv::connectedComponentsWithStats(mask, labels, stats, centroids, 8, CV_32S);
+    int number_labels = connectedComponentsWithStats(mask, labels, stats, centroids, 8, CV_32S);
 
-    // Start from 1 to skip the background
+    /*
+        The enclosing circle diameter of a component lies between the largest side of its bounding box
+        (distances between pixel centers) and the bounding box diagonal. Only components whose diameter
+        is not decided by the bounding box need their minimum enclosing circle.
+    */
+    vector<bool> keep_label(number_labels, true);
+    vector<int> points_offsets(number_labels + 1, 0);
+    bool needs_enclosing_circles = false;
     for (int label = 1; label < number_labels; ++label)
     {
-        Mat component = (labels == label);
-
-        // Find the minimum enclosing circle
-        vector<Point> points;
-        findNonZero(component, points);
-        Point2f center;
-        float radius;
-        minEnclosingCircle(points, center, radius);
+        int width_extent = stats.at<int>(label, CC_STAT_WIDTH) - 1;
+        int height_extent = stats.at<int>(label, CC_STAT_HEIGHT) - 1;
+        int points_number = 0;
 
-        double diameter = 2 * radius;
-        if (diameter < min_diameter)
-            mask.setTo(0, component);
+        if (sqrt(width_extent * width_extent + height_extent * height_extent) < min_diameter)
+        {
+            keep_label[label] = false;
+        }
+        else if (max(width_extent, height_extent) < min_diameter)
+        {
+            points_number = stats.at<int>(label, CC_STAT_AREA);
+            needs_enclosing_circles = true;
+        }
+        points_offsets[label + 1] = points_offsets[label] + points_number;
     }
-}
 
-float balls_localizer::get_white_ratio_in_circle_stripes(const Mat &src, const Mat &segmentation_mask, Vec3f circle)
-{
-    if (segmentation_mask.type() != CV_8UC1)
+    if (needs_enclosing_circles)
     {
-        const string INVALID_MASK = "Argument does not represent a mask.";
-        throw invalid_argument(INVALID_MASK);
-    }
-
-    Mat src_hsv;
-    cvtColor(src, src_hsv, COLOR_BGR2HSV);
-
-    Mat mask = Mat::zeros(src.size(), CV_8U);
-    get_circle_and_field_mask(segmentation_mask, circle, mask);
-
-    Mat masked_hsv;
-    src_hsv.copyTo(masked_hsv, mask);
-
-    Mat white_mask;
-    const Vec3b WHITE_HSV_LOWERBOUND = Vec3b(0, 0, 135);
-    const Vec3b WHITE_HSV_UPPERBOUND = Vec3b(120, 100, 255);
-
-    // Remove components with small diameter
-    const double MIN_DIAMETER = 8;
-    inRange(masked_hsv, WHITE_HSV_LOWERBOUND, WHITE_HSV_UPPERBOUND, white_mask);
-    remove_connected_components_by_diameter(white_mask, MIN_DIAMETER);
-
-    int white_pixels = countNonZero(white_mask);
-    int total_circle_pixels = countNonZero(mask);
-    double percentage_white = static_cast<double>(white_pixels) / total_circle_pixels;
+        // Group the points of the undecided components by label in a single sweep, using the component areas as offsets.
+        vector<Point> points(points_offsets.back());
+        vector<int> points_positions(points_offsets.begin(), points_offsets.end() - 1);
+        for (int row = 0; row < labels.rows; row++)
+        {
+            const int *labels_row = labels.ptr<int>(row);
+            for (int col = 0; col < labels.cols; col++)
+            {
+                int label = labels_row[col];
+                if (points_offsets[label + 1] > points_offsets[label])
+                    points[points_positions[label]++] = Point(col, row);
+            }
+        }
 
-    return percentage_white;
-}
+        for (int label = 1; label < number_labels; ++label)
+        {
+            if (points_offsets[label + 1] == points_offsets[label])
+                continue;
+
+            // Find the minimum enclosing circle
+            int points_number = points_offsets[label + 1] - points_offsets[label];
+            Mat component_points(points_number, 1, CV_32SC2, &points[points_offsets[label]]);
+            Point2f center;
+            float radius;
+            minEnclosingCircle(component_points, center, radius);
+
+            double diameter = 2 * radius;
+            if (diameter < min_diameter)
+                keep_label[label] = false;
+        }
+    }
 
-float balls_localizer::distance_from_middle_hue(const Mat &src, const Mat &segmentation_mask, Vec3f circle)
-{
-    if (segmentation_mask.type() != CV_8UC1)
+    for (int row = 0; row < mask.rows; row++)
     {
-        const string INVALID_MASK = "Argument does not represent a mask.";
-        throw invalid_argument(INVALID_MASK);
+        const int *labels_row = labels.ptr<int>(row);
+        uchar *mask_row = mask.ptr<uchar>(row);
+        for (int col = 0; col < mask.cols; col++)
+        {
+            if (!keep_label[labels_row[col]])
+                mask_row[col] = 0;
+        }
     }
-    
-    Mat src_hsv;
-    cvtColor(src, src_hsv, COLOR_BGR2HSV);
-
-    Mat mask = Mat::zeros(src.size(), CV_8U);
-    get_circle_and_field_mask(segmentation_mask, circle, mask);
+}
 
-    vector<Mat> channels;
-    split(src_hsv, channels);
+float balls_localizer::get_white_ratio_in_circle_stripes(const ball_features &features)
+{
+    return static_cast<double>(features.stripe_white_pixels) / features.valid_pixels;
+}
 
+float balls_localizer::distance_from_middle_hue(const ball_features &features)
+{
     // Compute distance of the mean hue value from 128
     const float MIDDLE_HUE = 128;
-    return abs(mean(channels[0], mask)[0] - MIDDLE_HUE);
+    return abs(features.mean_hue - MIDDLE_HUE);
 }
 
-void balls_localizer::find_cue_ball(const Mat &src, const Mat &segmentation_mask, const vector<Vec3f> &circles)
+void balls_localizer::find_cue_ball(const vector<Vec3f> &circles, const vector<ball_features> &features)
 {
     // We compute, for each circle, the percentage of "white" pixels. The one with highest percentage is picked as white ball.
-    vector<pair<Vec3f, float>> circles_white_ratios;
-    for (Vec3f circle : circles)
-    {
-        circles_white_ratios.push_back({circle, get_white_ratio_in_circle_cue(src, segmentation_mask, circle)});
-    }
+    vector<pair<int, float>> circles_white_ratios;
+    for (int i = 0; i < circles.size(); i++)
+        circles_white_ratios.push_back({i, get_white_ratio_in_circle_cue(features.at(i))});
 
     //  Sort by descending order of percentage
-    sort(circles_white_ratios.begin(), circles_white_ratios.end(), [](const pair<Vec3f, float> &a, const pair<Vec3f, float> &b)
+    sort(circles_white_ratios.begin(), circles_white_ratios.end(), [](const pair<int, float> &a, const pair<int, float> &b)
          { return a.second > b.second; });
 
-    Vec3f white_ball_circle;
-    float cue_ball_circle_confidence;
+    int cue_ball_index;
     const float MAX_DIFFERENCE_THRESHOLD = 0.1;
 
     if (circles_white_ratios.at(0).second - circles_white_ratios.at(1).second > MAX_DIFFERENCE_THRESHOLD)
     {
-        white_ball_circle = circles_white_ratios.at(0).first;
-        cue_ball_circle_confidence = circles_white_ratios.at(0).second;
+        cue_ball_index = 0;
     }
     else
     {
@@ -544,32 +1153,23 @@ void balls_localizer::find_cue_ball(const Mat &src, const Mat &segmentation_mask
             ball in the shadowed parts will be near the table color hue. So we pick the ball with mean hue nearer
             to the middle hue, that is 128.
         */
-        double difference_0 = distance_from_middle_hue(src, segmentation_mask, circles_white_ratios.at(0).first);
-        double difference_1 = distance_from_middle_hue(src, segmentation_mask, circles_white_ratios.at(1).first);
-
-        if (difference_0 < difference_1)
-        {
-            white_ball_circle = circles_white_ratios.at(0).first;
-            cue_ball_circle_confidence = circles_white_ratios.at(0).second;
-        }
-        else
-        {
-            white_ball_circle = circles_white_ratios.at(1).first;
-            cue_ball_circle_confidence = circles_white_ratios.at(1).second;
-        }
+        double difference_0 = distance_from_middle_hue(features.at(circles_white_ratios.at(0).first));
+        double difference_1 = distance_from_middle_hue(features.at(circles_white_ratios.at(1).first));
+        cue_ball_index = difference_0 < difference_1 ? 0 : 1;
     }
 
+    Vec3f white_ball_circle = circles.at(circles_white_ratios.at(cue_ball_index).first);
     localization.cue.circle = white_ball_circle;
     localization.cue.bounding_box = get_bounding_box(white_ball_circle);
-    localization.cue.confidence = cue_ball_circle_confidence;
+    localization.cue.confidence = circles_white_ratios.at(cue_ball_index).second;
 }
 
-void balls_localizer::find_black_ball(const Mat &src, const Mat &segmentation_mask, const vector<Vec3f> &circles)
+void balls_localizer::find_black_ball(const vector<Vec3f> &circles, const vector<ball_features> &features)
 {
-    // We compute, for each circle, the percentage of "white" pixels. The one with highest percentage is picked as white ball.
+    // We compute, for each circle, the percentage of "black" pixels. The one with highest percentage is picked as black ball.
     vector<pair<Vec3f, float>> circles_black_ratios;
-    for (Vec3f circle : circles)
-        circles_black_ratios.push_back({circle, get_black_ratio_in_circle(src, segmentation_mask, circle)});
+    for (int i = 0; i < circles.size(); i++)
+        circles_black_ratios.push_back({circles.at(i), get_black_ratio_in_circle(features.at(i))});
 
     // Sort by descending order of percentage
     sort(circles_black_ratios.begin(), circles_black_ratios.end(), [](const pair<Vec3f, float> &a, const pair<Vec3f, float> &b)
@@ -580,12 +1180,12 @@ void balls_localizer::find_black_ball(const Mat &src, const Mat &segmentation_ma
     localization.black.confidence = circles_black_ratios.at(0).second;
 }
 
-void balls_localizer::find_stripe_balls(const Mat &src, const Mat &segmentation_mask, const vector<Vec3f> &circles)
+void balls_localizer::find_stripe_balls(const vector<Vec3f> &circles, const vector<ball_features> &features)
 {
     // We compute, for each circle, the percentage of "white" pixels.
     vector<pair<Vec3f, float>> circles_white_ratios;
-    for (Vec3f circle : circles)
-        circles_white_ratios.push_back({circle, get_white_ratio_in_circle_stripes(src, segmentation_mask, circle)});
+    for (int i = 0; i < circles.size(); i++)
+        circles_white_ratios.push_back({circles.at(i), get_white_ratio_in_circle_stripes(features.at(i))});
 
     vector<pair<Vec3f, float>> circles_white_ratios_filtered;
     copy_if(circles_white_ratios.begin(), circles_white_ratios.end(), back_inserter(circles_white_ratios_filtered), [](pair<Vec3f, float> p)
@@ -610,7 +1210,7 @@ void balls_localizer::find_stripe_balls(const Mat &src, const Mat &segmentation_
     }
 }
 
-void balls_localizer::find_solid_balls(const Mat &src, const Mat &segmentation_mask, const vector<Vec3f> &circles)
+void balls_localizer::find_solid_balls(const vector<Vec3f> &circles)
 {
     vector<Vec3f> solids_circles;
     // Exclude cue, black and stripes
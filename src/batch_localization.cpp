@@ -0,0 +1,94 @@
+// Author: Nicola Maritan 2121717
+
+#include "batch_localization.h"
+
+using namespace cv;
+using namespace std;
+
+batch_localizer::batch_localizer(const balls_localizer_options &options, int workers, const playing_field_localizer_options &plf_options)
+    : options{options}, plf_options{plf_options}
+{
+    if (workers < 1)
+    {
+        const string INVALID_WORKERS = "Invalid number of workers for batch localizer.";
+        throw invalid_argument(INVALID_WORKERS);
+    }
+
+    this->workers.resize(workers);
+}
+
+void batch_localizer::localize_batch(const vector<Mat> &frames, vector<frame_localization> &localizations)
+{
+    localizations.resize(frames.size());
+    const int active_workers = min(static_cast<int>(workers.size()), static_cast<int>(frames.size()));
+    if (active_workers <= 1)
+    {
+        for (int i = 0; i < frames.size(); i++)
+            localize_frame(workers.at(0), frames.at(i), localizations.at(i));
+        return;
+    }
+
+    // Each worker takes every n-th frame, so that its state is never shared
+    parallel_for_(Range(0, active_workers), [&](const Range &range)
+                  {
+        for (int worker = range.start; worker < range.end; worker++)
+        {
+            for (int i = worker; i < frames.size(); i += active_workers)
+                localize_frame(workers.at(worker), frames.at(i), localizations.at(i));
+        } });
+}
+
+frame_arena_statistics batch_localizer::get_arena_statistics() const
+{
+    frame_arena_statistics statistics;
+    for (const localization_worker &worker : workers)
+    {
+        if (worker.arena)
+            accumulate_frame_arena_statistics(statistics, worker.arena->get_statistics());
+    }
+    return statistics;
+}
+
+void batch_localizer::localize_frame(localization_worker &worker, const Mat &frame, frame_localization &localization)
+{
+    if (!worker.arena)
+        worker.arena = make_unique<frame_arena>();
+
+    playing_field_localization plf_localization;
+    {
+        // Every matrix created by the localizers comes from the arena of the worker
+        frame_arena_scope arena_scope(*worker.arena);
+        if (!worker.context)
+            worker.context = make_unique<frame_context>(frame);
+        else
+            worker.context->set_frame(frame);
+
+        if (!worker.plf_localizer)
+        {
+            playing_field_localizer_options worker_plf_options = plf_options;
+            worker_plf_options.crop_to_table = options.crop_to_table;
+            worker.plf_localizer = make_unique<playing_field_localizer>(worker_plf_options);
+        }
+        worker.plf_localizer->localize(*worker.context);
+        plf_localization = worker.plf_localizer->get_localization();
+
+        if (!worker.blls_localizer)
+            worker.blls_localizer = make_unique<balls_localizer>(plf_localization, options);
+        else
+            worker.blls_localizer->set_playing_field(plf_localization);
+        worker.blls_localizer->localize(*worker.context);
+    }
+
+    // The images of the results are copied out of the arena, so that they do not keep its chunks from being reused
+    const frame_resolution &resolution = worker.context->get_resolution();
+    map_to_source(plf_localization, resolution, localization.playing_field);
+    if (resolution.working_size == resolution.source_size)
+    {
+        localization.playing_field.mask = localization.playing_field.mask.clone();
+        localization.playing_field.cushion_distance = localization.playing_field.cushion_distance.clone();
+        localization.playing_field.table_homography = localization.playing_field.table_homography.clone();
+    }
+    map_to_source(worker.blls_localizer->get_localization(), resolution, localization.balls);
+    localization.filters_statistics = worker.blls_localizer->get_filters_statistics();
+    worker.arena->reset();
+}
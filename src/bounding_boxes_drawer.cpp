@@ -5,8 +5,8 @@
 using namespace std;
 using namespace cv;
 
-bounding_boxes_drawer::bounding_boxes_drawer(const playing_field_localization &plf_localization, const balls_localization &blls_localization, const std::vector<cv::Rect2d> &tracker_bboxes)
-    : playing_field{plf_localization}, balls{blls_localization}
+bounding_boxes_drawer::bounding_boxes_drawer(const playing_field_localization &plf_localization, const balls_localization &blls_localization, const std::vector<cv::Rect2d> &tracker_bboxes, const frame_resolution &resolution)
+    : playing_field{plf_localization}, balls{blls_localization}, resolution{resolution}
 {
     vector<Point> balls_pos;
     for (Rect2d bounding_box : tracker_bboxes)
@@ -67,21 +67,26 @@ void bounding_boxes_drawer::draw(const cv::Mat &frame, cv::Mat &dst, const std::
     const Scalar BLUE = Scalar(255, 0, 0);
     const Scalar RED = Scalar(0, 0, 255);
 
-    draw_transparent_rect(dst, updated_balls_bboxes.at(cue_index), WHITE, ALPHA);
-    draw_transparent_rect(dst, updated_balls_bboxes.at(black_index), BLACK, ALPHA);
+    // The boxes are mapped to the source frame when drawn
+    draw_transparent_rect(dst, map_box_to_source(updated_balls_bboxes.at(cue_index), resolution), WHITE, ALPHA);
+    draw_transparent_rect(dst, map_box_to_source(updated_balls_bboxes.at(black_index), resolution), BLACK, ALPHA);
 
     for (int index : solids_indeces)
     {
-        draw_transparent_rect(dst, updated_balls_bboxes.at(index), BLUE, ALPHA);
+        draw_transparent_rect(dst, map_box_to_source(updated_balls_bboxes.at(index), resolution), BLUE, ALPHA);
     }
 
     for (int index : stripes_indeces)
     {
-        draw_transparent_rect(dst, updated_balls_bboxes.at(index), RED, ALPHA);
+        draw_transparent_rect(dst, map_box_to_source(updated_balls_bboxes.at(index), resolution), RED, ALPHA);
     }
 
     // Draw yellow lines
-    vector<Point> corners = playing_field.corners;
+    const double x_factor = static_cast<double>(resolution.source_size.width) / resolution.working_size.width;
+    const double y_factor = static_cast<double>(resolution.source_size.height) / resolution.working_size.height;
+    vector<Point> corners;
+    for (const Point &corner : playing_field.corners)
+        corners.push_back(Point(cvRound(corner.x * x_factor), cvRound(corner.y * y_factor)));
     for (size_t i = 0; i < corners.size(); i++)
     {
         const Scalar YELLOW_COLOR = Scalar(0, 255, 255);
@@ -0,0 +1,113 @@
+// Author: Nicola Maritan 2121717
+
+#include "circle_filter_cascade.h"
+
+#include <algorithm>
+#include <limits>
+
+using namespace cv;
+using namespace std;
+
+void circle_filter_cascade::add_stage(const string &name, const circle_filter &filter)
+{
+    stages.push_back({name, filter});
+}
+
+void circle_filter_cascade::set_final_stage(const string &name, const circle_filter &filter)
+{
+    final_stage = {name, filter};
+}
+
+void circle_filter_cascade::set_order(const vector<string> &order)
+{
+    vector<circle_filter_stage> ordered_stages;
+    for (const string &name : order)
+    {
+        // The final stage runs last anyway
+        if (final_stage.filter && name == final_stage.name)
+            continue;
+
+        auto stage = find_if(stages.begin(), stages.end(), [&name](const circle_filter_stage &stage)
+                             { return stage.name == name; });
+        if (stage == stages.end())
+        {
+            const string UNKNOWN_STAGE = "Unknown circle filter stage " + name;
+            throw invalid_argument(UNKNOWN_STAGE);
+        }
+
+        ordered_stages.push_back(*stage);
+        stages.erase(stage);
+    }
+
+    ordered_stages.insert(ordered_stages.end(), stages.begin(), stages.end());
+    stages = ordered_stages;
+}
+
+void circle_filter_cascade::apply(vector<Vec3f> &circles)
+{
+    vector<bool> rejected(circles.size(), false);
+    int candidates = circles.size();
+    statistics.clear();
+
+    for (const circle_filter_stage &stage : stages)
+        run_stage(stage, circles, rejected, candidates);
+
+    if (final_stage.filter)
+        run_stage(final_stage, circles, rejected, candidates);
+
+    vector<Vec3f> filtered_circles;
+    for (int i = 0; i < circles.size(); i++)
+    {
+        if (!rejected[i])
+            filtered_circles.push_back(circles.at(i));
+    }
+    circles = filtered_circles;
+}
+
+void circle_filter_cascade::run_stage(const circle_filter_stage &stage, const vector<Vec3f> &circles, vector<bool> &rejected, int &candidates)
+{
+    const int64 start = getTickCount();
+    stage.filter(circles, rejected);
+    const double time = (getTickCount() - start) * 1000.0 / getTickFrequency();
+
+    const int remaining = count(rejected.begin(), rejected.end(), false);
+    statistics.push_back({stage.name, candidates, candidates - remaining, time});
+    candidates = remaining;
+}
+
+void accumulate_circle_filter_statistics(vector<circle_filter_statistics> &total, const vector<circle_filter_statistics> &statistics)
+{
+    for (const circle_filter_statistics &stage_statistics : statistics)
+    {
+        auto stage_total = find_if(total.begin(), total.end(), [&stage_statistics](const circle_filter_statistics &stage_total)
+                                   { return stage_total.name == stage_statistics.name; });
+        if (stage_total == total.end())
+            total.push_back(stage_statistics);
+        else
+        {
+            stage_total->candidates += stage_statistics.candidates;
+            stage_total->rejected += stage_statistics.rejected;
+            stage_total->time += stage_statistics.time;
+        }
+    }
+}
+
+void get_circle_filter_order(const vector<circle_filter_statistics> &statistics, vector<string> &order)
+{
+    // Expected cost of the stage per rejected candidate
+    vector<pair<double, string>> ranked_stages;
+    for (const circle_filter_statistics &stage_statistics : statistics)
+    {
+        double rank = numeric_limits<double>::max();
+        if (stage_statistics.rejected > 0)
+            rank = stage_statistics.time / stage_statistics.rejected;
+        ranked_stages.push_back({rank, stage_statistics.name});
+    }
+
+    stable_sort(ranked_stages.begin(), ranked_stages.end(), [](const pair<double, string> &lhs, const pair<double, string> &rhs)
+                { return lhs.first < rhs.first; });
+
+    order.clear();
+    for (const pair<double, string> &ranked_stage : ranked_stages)
+        order.push_back(ranked_stage.second);
+}
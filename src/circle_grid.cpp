@@ -0,0 +1,79 @@
+// Author: Nicola Maritan 2121717
+
+#include "circle_grid.h"
+
+#include <cmath>
+
+using namespace cv;
+using namespace std;
+
+circle_grid::circle_grid(const vector<Vec3f> &circles, float cell_size)
+    : cell_size{cell_size}, origin{0, 0}, cols{0}, rows{0}
+{
+    if (cell_size <= 0)
+    {
+        const string INVALID_CELL_SIZE = "Invalid cell size for the circle grid.";
+        throw invalid_argument(INVALID_CELL_SIZE);
+    }
+
+    if (circles.empty())
+    {
+        cell_starts.assign(1, 0);
+        return;
+    }
+
+    // The grid spans the bounding box of the centers
+    Point2f bottom_right(circles[0][0], circles[0][1]);
+    origin = bottom_right;
+    for (const Vec3f &circle : circles)
+    {
+        origin.x = min(origin.x, circle[0]);
+        origin.y = min(origin.y, circle[1]);
+        bottom_right.x = max(bottom_right.x, circle[0]);
+        bottom_right.y = max(bottom_right.y, circle[1]);
+    }
+    cols = static_cast<int>((bottom_right.x - origin.x) / cell_size) + 1;
+    rows = static_cast<int>((bottom_right.y - origin.y) / cell_size) + 1;
+
+    // Counting sort of the circles by cell
+    vector<int> circle_cells(circles.size());
+    cell_starts.assign(rows * cols + 1, 0);
+    for (int i = 0; i < circles.size(); i++)
+    {
+        const int col = min(static_cast<int>((circles[i][0] - origin.x) / cell_size), cols - 1);
+        const int row = min(static_cast<int>((circles[i][1] - origin.y) / cell_size), rows - 1);
+        circle_cells[i] = row * cols + col;
+        cell_starts[circle_cells[i] + 1]++;
+    }
+
+    for (int cell = 0; cell < rows * cols; cell++)
+        cell_starts[cell + 1] += cell_starts[cell];
+
+    vector<int> cell_ends(cell_starts.begin(), cell_starts.end() - 1);
+    cell_circles.resize(circles.size());
+    for (int i = 0; i < circles.size(); i++)
+        cell_circles[cell_ends[circle_cells[i]]++] = i;
+}
+
+void circle_grid::query(Point2f point, float distance, vector<int> &indices) const
+{
+    indices.clear();
+
+    const Range cols_range = get_cells_range(point.x - distance, point.x + distance, origin.x, cols);
+    const Range rows_range = get_cells_range(point.y - distance, point.y + distance, origin.y, rows);
+    for (int row = rows_range.start; row < rows_range.end; row++)
+    {
+        for (int col = cols_range.start; col < cols_range.end; col++)
+        {
+            const int cell = row * cols + col;
+            indices.insert(indices.end(), cell_circles.begin() + cell_starts[cell], cell_circles.begin() + cell_starts[cell + 1]);
+        }
+    }
+}
+
+Range circle_grid::get_cells_range(float start, float end, float origin, int cells) const
+{
+    const int first = max(static_cast<int>(floor((start - origin) / cell_size)), 0);
+    const int last = min(static_cast<int>(floor((end - origin) / cell_size)), cells - 1);
+    return first <= last ? Range(first, last + 1) : Range(0, 0);
+}
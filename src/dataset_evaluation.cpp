@@ -3,6 +3,7 @@
 #include "dataset_evaluation.h"
 #include "performance_measurement.h"
 #include "balls_localization.h"
+#include "batch_localization.h"
 #include "frame_segmentation.h"
 #include "frame_detection.h"
 #include "file_loading.h"
@@ -15,7 +16,22 @@ using namespace std;
 using namespace cv;
 namespace fs = std::filesystem;
 
-void evaluate(const string &dataset_path)
+/**
+ * @brief Segments the frames and localizes their balls, measuring the localization.
+ *
+ * @param filenames The filenames of the frames.
+ * @param options The options of the balls localizer.
+ * @param workers The number of frames localized in parallel.
+ * @param plf_options The options of the playing field localizer.
+ * @param predicted_table_masks The output segmentations of the frames.
+ * @param predicted_balls_localizations The output localizations of the balls of the frames.
+ * @param filters_statistics The output statistics of the circle filters, accumulated over the frames.
+ * @param localization_time The output overall time of the localizations, in milliseconds.
+ * @param arena_statistics The output counters of the frame arenas of the localizations.
+ */
+void predict_frames(const vector<String> &filenames, const balls_localizer_options &options, int workers, const playing_field_localizer_options &plf_options, vector<Mat> &predicted_table_masks, vector<balls_localization> &predicted_balls_localizations, vector<circle_filter_statistics> &filters_statistics, double &localization_time, frame_arena_statistics &arena_statistics);
+
+void evaluate(const string &dataset_path, const balls_localizer_options &options, int workers, const playing_field_localizer_options &plf_options)
 {
     const string OUTPUT_DIRECTORY = "output";
     const string PERFORMANCE_FILE = "performance.txt";
@@ -30,23 +46,15 @@ void evaluate(const string &dataset_path)
     vector<String> frames_filenames;
     vector<balls_localization> predicted_balls_localizations;
     vector<balls_localization> ground_truth_balls_localizations;
+    vector<circle_filter_statistics> filters_statistics;
+    double localization_time = 0;
+    frame_arena_statistics arena_statistics;
 
     cout << "Generating " << output_directory.string() << "..."  << endl;
 
     // Get filenames and obtain segmentation and localization
     get_frame_files(dataset_path, filenames);
-    for (const string &filename : filenames)
-    {
-        Mat frame = imread(filename);
-        Mat frame_segmentation;
-        balls_localization localization;
-
-        get_frame_segmentation(frame, frame_segmentation);
-        get_balls_localization(frame, localization);
-
-        predicted_table_masks.push_back(frame_segmentation);
-        predicted_balls_localizations.push_back(localization);
-    }
+    predict_frames(filenames, options, workers, plf_options, predicted_table_masks, predicted_balls_localizations, filters_statistics, localization_time, arena_statistics);
 
     // Load ground truth masks
     get_mask_files(dataset_path, filenames);
@@ -77,10 +85,108 @@ void evaluate(const string &dataset_path)
         performance_file << endl;
     }
 
-    performance_file << "Dataset mIoU: " << evaluate_balls_and_playing_field_segmentation_dataset(predicted_table_masks, ground_truth_table_masks) << endl;
-    performance_file << "Dataset mAP: " << evaluate_balls_localization_dataset(predicted_balls_localizations, ground_truth_balls_localizations) << endl;
+    const double dataset_miou = evaluate_balls_and_playing_field_segmentation_dataset(predicted_table_masks, ground_truth_table_masks);
+    const double dataset_map = evaluate_balls_localization_dataset(predicted_balls_localizations, ground_truth_balls_localizations);
+    performance_file << "Dataset mIoU: " << dataset_miou << endl;
+    performance_file << "Dataset mAP: " << dataset_map << endl;
+
+    // Throughput of the localization, to compare the candidate generators and the processing modes
+    const string GENERATOR_NAME = options.generator == distance_transform_generator ? "distance_transform" : "hough";
+    performance_file << "Candidate generator: " << GENERATOR_NAME << endl;
+    performance_file << "Crop to table: " << (options.crop_to_table ? "yes" : "no") << endl;
+    performance_file << "Rectify table: " << (options.rectify_table ? "yes" : "no") << endl;
+    performance_file << "Parallel frames: " << workers << endl;
+    performance_file << "Color clustering sample step: " << plf_options.kmeans_sample_step << endl;
+    performance_file << "Color clustering warm start: " << (plf_options.kmeans_warm_start ? "yes" : "no") << endl;
+    performance_file << "Circle filters order:";
+    for (const string &filter_name : options.filters_order)
+        performance_file << " " << filter_name;
+    performance_file << (options.filters_order.empty() ? " default" : "") << endl;
+    performance_file << "Mean localization time (ms): " << localization_time / max(static_cast<int>(predicted_balls_localizations.size()), 1) << endl;
+
+    // Memory of the localization temporaries, taken from the heap only while the arenas warm up
+    const double BYTES_PER_MB = 1 << 20;
+    performance_file << "Arena allocated per frame (MB): " << arena_statistics.allocated_bytes / BYTES_PER_MB / max(static_cast<int>(predicted_balls_localizations.size()), 1) << endl;
+    performance_file << "Arena peak usage (MB): " << arena_statistics.peak_bytes / BYTES_PER_MB << endl;
+    performance_file << "Arena reserved (MB): " << arena_statistics.reserved_bytes / BYTES_PER_MB << endl;
+    performance_file << "Arena heap allocations: " << arena_statistics.heap_allocations << endl;
+    performance_file << "Arena heap allocations after the first frame: " << arena_statistics.warm_heap_allocations << endl;
+
+    // Accuracy lost and time saved by the coarse to fine localization, against the full resolution one
+    if (options.pyramid_levels > 0)
+    {
+        balls_localizer_options full_resolution_options = options;
+        full_resolution_options.pyramid_levels = 0;
+        vector<Mat> full_resolution_table_masks;
+        vector<balls_localization> full_resolution_balls_localizations;
+        vector<circle_filter_statistics> full_resolution_filters_statistics;
+        double full_resolution_localization_time = 0;
+        frame_arena_statistics full_resolution_arena_statistics;
+        get_frame_files(dataset_path, filenames);
+        predict_frames(filenames, full_resolution_options, workers, plf_options, full_resolution_table_masks, full_resolution_balls_localizations, full_resolution_filters_statistics, full_resolution_localization_time, full_resolution_arena_statistics);
+
+        const double full_resolution_miou = evaluate_balls_and_playing_field_segmentation_dataset(full_resolution_table_masks, ground_truth_table_masks);
+        const double full_resolution_map = evaluate_balls_localization_dataset(full_resolution_balls_localizations, ground_truth_balls_localizations);
+        performance_file << "Pyramid levels: " << options.pyramid_levels << endl;
+        performance_file << "Full resolution dataset mIoU: " << full_resolution_miou << endl;
+        performance_file << "Full resolution dataset mAP: " << full_resolution_map << endl;
+        performance_file << "mIoU difference from full resolution: " << dataset_miou - full_resolution_miou << endl;
+        performance_file << "mAP difference from full resolution: " << dataset_map - full_resolution_map << endl;
+        performance_file << "Full resolution mean localization time (ms): " << full_resolution_localization_time / max(static_cast<int>(full_resolution_balls_localizations.size()), 1) << endl;
+    }
+
+    // Selectivity and cost of the circle filters, to tune their order
+    performance_file << endl;
+    for (const circle_filter_statistics &stage_statistics : filters_statistics)
+    {
+        const int candidates = max(stage_statistics.candidates, 1);
+        performance_file << "Circle filter " << stage_statistics.name
+                         << " candidates: " << stage_statistics.candidates
+                         << ", rejected: " << stage_statistics.rejected
+                         << ", rejection rate: " << static_cast<double>(stage_statistics.rejected) / candidates
+                         << ", time per candidate (ms): " << stage_statistics.time / candidates << endl;
+    }
     performance_file.close();
 
     cout << "Generated " << output_directory.string() << "."  << endl;
 
-}
\ No newline at end of file
+}
+
+void rank_circle_filters(const string &dataset_path, const balls_localizer_options &options, int workers, const playing_field_localizer_options &plf_options, vector<string> &order)
+{
+    vector<String> filenames;
+    vector<Mat> predicted_table_masks;
+    vector<balls_localization> predicted_balls_localizations;
+    vector<circle_filter_statistics> filters_statistics;
+    double localization_time = 0;
+    frame_arena_statistics arena_statistics;
+
+    get_frame_files(dataset_path, filenames);
+    predict_frames(filenames, options, workers, plf_options, predicted_table_masks, predicted_balls_localizations, filters_statistics, localization_time, arena_statistics);
+    get_circle_filter_order(filters_statistics, order);
+}
+
+void predict_frames(const vector<String> &filenames, const balls_localizer_options &options, int workers, const playing_field_localizer_options &plf_options, vector<Mat> &predicted_table_masks, vector<balls_localization> &predicted_balls_localizations, vector<circle_filter_statistics> &filters_statistics, double &localization_time, frame_arena_statistics &arena_statistics)
+{
+    vector<Mat> frames;
+    for (const string &filename : filenames)
+        frames.push_back(imread(filename));
+
+    // The whole dataset is a single batch, each frame being localized once for both the segmentation and the balls
+    batch_localizer localizer(options, workers, plf_options);
+    vector<frame_localization> localizations;
+    const int64 localization_start = getTickCount();
+    localizer.localize_batch(frames, localizations);
+    localization_time += (getTickCount() - localization_start) * 1000.0 / getTickFrequency();
+    accumulate_frame_arena_statistics(arena_statistics, localizer.get_arena_statistics());
+
+    for (int i = 0; i < frames.size(); i++)
+    {
+        Mat frame_segmentation;
+        draw_frame_segmentation(localizations.at(i).playing_field, localizations.at(i).balls, frames.at(i).size(), frame_segmentation);
+        accumulate_circle_filter_statistics(filters_statistics, localizations.at(i).filters_statistics);
+
+        predicted_table_masks.push_back(frame_segmentation);
+        predicted_balls_localizations.push_back(localizations.at(i).balls);
+    }
+}
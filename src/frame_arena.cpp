@@ -0,0 +1,234 @@
+// Author: Nicola Maritan 2121717
+
+#include "frame_arena.h"
+
+#include <atomic>
+#include <new>
+
+using namespace cv;
+using namespace std;
+
+/**
+ * @brief Structure holding a chunk of memory of a frame arena.
+ *
+ * The chunk is freed when its references reach zero, the arena holding one of them until its destruction.
+ */
+struct frame_arena_chunk
+{
+    uchar *memory;            // Memory of the chunk.
+    size_t size;              // Bytes of the chunk.
+    size_t used;              // Bytes bumped since the chunk was rewound, touched by the thread of the arena only.
+    atomic<int> references;   // One per alive block, plus the one of the arena.
+    atomic<size_t> alive_bytes; // Bytes of the alive blocks.
+};
+
+/**
+ * @brief Structure placed at the start of each block, before the header of its matrix.
+ */
+struct frame_arena_block
+{
+    frame_arena_chunk *chunk; // Chunk holding the block.
+    size_t size;              // Bytes of the block.
+};
+
+/**
+ * @brief Matrix allocator serving the matrices from the arena active on the calling thread, if any.
+ */
+class arena_mat_allocator : public MatAllocator
+{
+public:
+    UMatData *allocate(int dims, const int *sizes, int type, void *data, size_t *step, AccessFlag flags, UMatUsageFlags usage_flags) const override;
+    bool allocate(UMatData *data, AccessFlag access_flags, UMatUsageFlags usage_flags) const override;
+    void deallocate(UMatData *data) const override;
+};
+
+/**
+ * @brief Releases a reference of a chunk, freeing it with the last one.
+ *
+ * @param chunk The chunk.
+ */
+void release_chunk(frame_arena_chunk *chunk);
+
+/**
+ * @brief Returns the matrix allocator of the arenas, installing it as the default one on the first call.
+ *
+ * @return the allocator.
+ */
+const MatAllocator *get_arena_mat_allocator();
+
+const size_t BLOCK_ALIGNMENT = 64; // Alignment of the blocks and of the matrix data, as the one of cv::fastMalloc.
+const size_t BLOCK_HEADER_SIZE = (sizeof(frame_arena_block) + sizeof(UMatData) + BLOCK_ALIGNMENT - 1) / BLOCK_ALIGNMENT * BLOCK_ALIGNMENT;
+
+thread_local frame_arena *active_arena = nullptr; // Arena active on the thread, if any.
+
+void accumulate_frame_arena_statistics(frame_arena_statistics &total, const frame_arena_statistics &statistics)
+{
+    total.allocated_bytes += statistics.allocated_bytes;
+    total.frame_allocated_bytes += statistics.frame_allocated_bytes;
+    total.peak_bytes += statistics.peak_bytes;
+    total.reserved_bytes += statistics.reserved_bytes;
+    total.heap_allocations += statistics.heap_allocations;
+    total.warm_heap_allocations += statistics.warm_heap_allocations;
+}
+
+UMatData *arena_mat_allocator::allocate(int dims, const int *sizes, int type, void *data, size_t *step, AccessFlag flags, UMatUsageFlags usage_flags) const
+{
+    // Matrices over user data and the ones out of any arena are left to the standard allocator
+    if (active_arena == nullptr || data != nullptr)
+        return Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usage_flags);
+
+    size_t total = CV_ELEM_SIZE(type);
+    for (int i = dims - 1; i >= 0; i--)
+    {
+        if (step)
+            step[i] = total;
+        total *= sizes[i];
+    }
+    return active_arena->allocate(total, this);
+}
+
+bool arena_mat_allocator::allocate(UMatData *data, AccessFlag, UMatUsageFlags) const
+{
+    return data != nullptr;
+}
+
+void arena_mat_allocator::deallocate(UMatData *data) const
+{
+    if (data == nullptr)
+        return;
+
+    CV_Assert(data->urefcount == 0 && data->refcount == 0);
+    frame_arena_block *block = reinterpret_cast<frame_arena_block *>(reinterpret_cast<uchar *>(data) - sizeof(frame_arena_block));
+    frame_arena_chunk *chunk = block->chunk;
+    const size_t size = block->size;
+    data->~UMatData();
+    chunk->alive_bytes -= size;
+    release_chunk(chunk);
+}
+
+void release_chunk(frame_arena_chunk *chunk)
+{
+    if (chunk->references.fetch_sub(1) == 1)
+    {
+        fastFree(chunk->memory);
+        delete chunk;
+    }
+}
+
+const MatAllocator *get_arena_mat_allocator()
+{
+    // The allocator is never destroyed, since matrices may outlive every arena
+    static const MatAllocator *allocator = []()
+    {
+        arena_mat_allocator *arena_allocator = new arena_mat_allocator();
+        Mat::setDefaultAllocator(arena_allocator);
+        return arena_allocator;
+    }();
+    return allocator;
+}
+
+frame_arena::frame_arena(size_t chunk_size)
+    : chunk_size{chunk_size}, current_chunk{nullptr}
+{
+    if (chunk_size == 0)
+    {
+        const string INVALID_CHUNK_SIZE = "Invalid empty chunk size for frame arena.";
+        throw invalid_argument(INVALID_CHUNK_SIZE);
+    }
+}
+
+frame_arena::~frame_arena()
+{
+    for (frame_arena_chunk *chunk : chunks)
+        release_chunk(chunk);
+}
+
+void frame_arena::reset()
+{
+    for (frame_arena_chunk *chunk : chunks)
+    {
+        if (chunk->references.load() == 1)
+            chunk->used = 0;
+    }
+    statistics.frame_allocated_bytes = 0;
+    is_warm = true;
+}
+
+frame_arena_statistics frame_arena::get_statistics() const
+{
+    return statistics;
+}
+
+UMatData *frame_arena::allocate(size_t size, const MatAllocator *allocator)
+{
+    const size_t block_size = BLOCK_HEADER_SIZE + (size + BLOCK_ALIGNMENT - 1) / BLOCK_ALIGNMENT * BLOCK_ALIGNMENT;
+    frame_arena_chunk *chunk = get_chunk(block_size);
+    uchar *block_memory = chunk->memory + chunk->used;
+    chunk->used += block_size;
+    chunk->references++;
+    chunk->alive_bytes += block_size;
+
+    new (block_memory) frame_arena_block{chunk, block_size};
+    UMatData *data = new (block_memory + sizeof(frame_arena_block)) UMatData(allocator);
+    data->data = data->origdata = block_memory + BLOCK_HEADER_SIZE;
+    data->size = size;
+
+    // The alive bytes of the other chunks may be lowered meanwhile by other threads, so the peak is an upper bound
+    size_t alive_bytes = 0;
+    for (frame_arena_chunk *arena_chunk : chunks)
+        alive_bytes += arena_chunk->alive_bytes.load();
+    statistics.allocated_bytes += block_size;
+    statistics.frame_allocated_bytes += block_size;
+    statistics.peak_bytes = max(statistics.peak_bytes, alive_bytes);
+    return data;
+}
+
+frame_arena_chunk *frame_arena::get_chunk(size_t block_size)
+{
+    // The current chunk is rewound as soon as none of its blocks is alive
+    if (current_chunk != nullptr)
+    {
+        if (current_chunk->references.load() == 1)
+            current_chunk->used = 0;
+        if (current_chunk->used + block_size <= current_chunk->size)
+            return current_chunk;
+    }
+
+    // Otherwise the first large enough chunk without alive blocks
+    for (frame_arena_chunk *chunk : chunks)
+    {
+        if (chunk->references.load() == 1 && chunk->size >= block_size)
+        {
+            chunk->used = 0;
+            current_chunk = chunk;
+            return chunk;
+        }
+    }
+
+    frame_arena_chunk *chunk = new frame_arena_chunk();
+    chunk->size = max(chunk_size, block_size);
+    chunk->memory = static_cast<uchar *>(fastMalloc(chunk->size));
+    chunk->used = 0;
+    chunk->references = 1;
+    chunk->alive_bytes = 0;
+    chunks.push_back(chunk);
+    current_chunk = chunk;
+
+    statistics.reserved_bytes += chunk->size;
+    statistics.heap_allocations++;
+    if (is_warm)
+        statistics.warm_heap_allocations++;
+    return chunk;
+}
+
+frame_arena_scope::frame_arena_scope(frame_arena &arena)
+    : previous_arena{active_arena}
+{
+    get_arena_mat_allocator();
+    active_arena = &arena;
+}
+
+frame_arena_scope::~frame_arena_scope()
+{
+    active_arena = previous_arena;
+}
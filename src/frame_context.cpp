@@ -0,0 +1,162 @@
+// Author: Nicola Maritan 2121717
+
+#include "frame_context.h"
+
+using namespace cv;
+using namespace std;
+
+frame_resolution get_frame_resolution(const Size &source_size)
+{
+    if (source_size.empty())
+    {
+        const string EMPTY_SIZE_MESSAGE = "Invalid empty size for frame resolution.";
+        throw invalid_argument(EMPTY_SIZE_MESSAGE);
+    }
+
+    // The frame fits within the reference one keeping its aspect ratio, so the dimension exceeding it the most rules
+    const double source_scale = max(static_cast<double>(source_size.width) / REFERENCE_FRAME_SIZE.width, static_cast<double>(source_size.height) / REFERENCE_FRAME_SIZE.height);
+    frame_resolution resolution;
+    resolution.source_size = source_size;
+    resolution.working_size = source_size;
+    resolution.scale = source_scale;
+    if (source_scale > 1)
+    {
+        resolution.working_size = Size(max(cvRound(source_size.width / source_scale), 1), max(cvRound(source_size.height / source_scale), 1));
+        resolution.scale = 1;
+    }
+    return resolution;
+}
+
+int get_scaled_length(double length, double scale)
+{
+    return max(cvRound(length * scale), 1);
+}
+
+int get_scaled_filter_size(int size, double scale)
+{
+    return 2 * cvRound((size - 1) / 2.0 * scale) + 1;
+}
+
+Rect map_box_to_source(const Rect &box, const frame_resolution &resolution)
+{
+    const double x_factor = static_cast<double>(resolution.source_size.width) / resolution.working_size.width;
+    const double y_factor = static_cast<double>(resolution.source_size.height) / resolution.working_size.height;
+    return Rect(Point(cvRound(box.x * x_factor), cvRound(box.y * y_factor)), Point(cvRound(box.br().x * x_factor), cvRound(box.br().y * y_factor)));
+}
+
+frame_context::frame_context(const Mat &src)
+{
+    set_frame(src);
+}
+
+frame_context::frame_context(const Mat &src, double scale)
+    : source_frame{src}, frame{src}
+{
+    if (src.empty())
+    {
+        const string EMPTY_MAT_MESSAGE = "Invalid empty image for frame context.";
+        throw invalid_argument(EMPTY_MAT_MESSAGE);
+    }
+
+    resolution.source_size = src.size();
+    resolution.working_size = src.size();
+    resolution.scale = scale;
+}
+
+void frame_context::set_frame(const Mat &src)
+{
+    if (src.empty())
+    {
+        const string EMPTY_MAT_MESSAGE = "Invalid empty image for frame context.";
+        throw invalid_argument(EMPTY_MAT_MESSAGE);
+    }
+
+    // A working frame sharing the previous source frame must not be overwritten by the downsampling
+    if (frame.data == source_frame.data)
+        frame.release();
+    source_frame = src;
+
+    // Area interpolation averages the source pixels, avoiding aliasing when downsampling
+    resolution = get_frame_resolution(src.size());
+    if (resolution.working_size == src.size())
+        frame = src;
+    else
+        resize(src, frame, resolution.working_size, 0, 0, INTER_AREA);
+
+    hsv.is_valid = false;
+    for (auto &cached : blurred)
+        cached.second.is_valid = false;
+    for (auto &cached : blurred_hsv)
+        cached.second.is_valid = false;
+    for (auto &cached : blurred_hsv_channels)
+        cached.second.is_valid = false;
+    for (auto &cached : pyramid)
+        cached.second.is_valid = false;
+    for (auto &cached : pyramid_hsv)
+        cached.second.is_valid = false;
+}
+
+const Mat &frame_context::get_hsv()
+{
+    if (!hsv.is_valid)
+        cvtColor(frame, hsv.image, COLOR_BGR2HSV);
+    hsv.is_valid = true;
+    return hsv.image;
+}
+
+const Mat &frame_context::get_blurred(int filter_size, double filter_sigma)
+{
+    cached_image &blurred_frame = blurred[{filter_size, filter_sigma}];
+    if (!blurred_frame.is_valid)
+        GaussianBlur(frame, blurred_frame.image, Size(filter_size, filter_size), filter_sigma, filter_sigma);
+    blurred_frame.is_valid = true;
+    return blurred_frame.image;
+}
+
+const Mat &frame_context::get_blurred_hsv(int filter_size, double filter_sigma)
+{
+    cached_image &blurred_hsv_frame = blurred_hsv[{filter_size, filter_sigma}];
+    if (!blurred_hsv_frame.is_valid)
+        cvtColor(get_blurred(filter_size, filter_sigma), blurred_hsv_frame.image, COLOR_BGR2HSV);
+    blurred_hsv_frame.is_valid = true;
+    return blurred_hsv_frame.image;
+}
+
+const vector<Mat> &frame_context::get_blurred_hsv_channels(int filter_size, double filter_sigma)
+{
+    cached_channels &channels = blurred_hsv_channels[{filter_size, filter_sigma}];
+    if (!channels.is_valid)
+        split(get_blurred_hsv(filter_size, filter_sigma), channels.channels);
+    channels.is_valid = true;
+    return channels.channels;
+}
+
+const Mat &frame_context::get_pyramid_level(int level)
+{
+    if (level < 0)
+    {
+        const string INVALID_LEVEL = "Invalid negative pyramid level.";
+        throw invalid_argument(INVALID_LEVEL);
+    }
+
+    if (level == 0)
+        return frame;
+
+    cached_image &downsampled = pyramid[level];
+    if (!downsampled.is_valid)
+        pyrDown(get_pyramid_level(level - 1), downsampled.image);
+    downsampled.is_valid = true;
+    return downsampled.image;
+}
+
+const Mat &frame_context::get_pyramid_hsv(int level)
+{
+    if (level == 0)
+        return get_hsv();
+
+    cached_image &hsv_level = pyramid_hsv[level];
+    if (!hsv_level.is_valid)
+        cvtColor(get_pyramid_level(level), hsv_level.image, COLOR_BGR2HSV);
+    hsv_level.is_valid = true;
+    return hsv_level.image;
+}
@@ -31,12 +31,18 @@ void get_frame_detection(const Mat &src, Mat &dst)
     
     dst = src.clone();
 
+    frame_context context(src);
     playing_field_localizer plf_localizer;
-    plf_localizer.localize(src);
+    plf_localizer.localize(context);
 
     balls_localizer blls_localizer(plf_localizer.get_localization());
-    blls_localizer.localize(src);
-    balls_localization blls_localization = blls_localizer.get_localization();
+    blls_localizer.localize(context);
+
+    // Localizations are drawn on the source frame
+    playing_field_localization plf_localization;
+    balls_localization blls_localization;
+    map_to_source(plf_localizer.get_localization(), context.get_resolution(), plf_localization);
+    map_to_source(blls_localizer.get_localization(), context.get_resolution(), blls_localization);
 
     const float ALPHA = 0.4;
     const Scalar WHITE = Scalar(255, 255, 255);
@@ -54,7 +60,7 @@ void get_frame_detection(const Mat &src, Mat &dst)
         draw_transparent_rect(dst, localization.bounding_box, RED, ALPHA);
 
     // Draw yellow lines
-    vector<Point> corners = plf_localizer.get_localization().corners;
+    vector<Point> corners = plf_localization.corners;
     for (size_t i = 0; i < corners.size(); i++)
     {
         const Scalar YELLOW_COLOR = Scalar(0, 255, 255);
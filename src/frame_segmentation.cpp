@@ -28,17 +28,20 @@ void get_colored_frame_segmentation(const Mat &src, Mat &dst, bool preserve_back
         throw invalid_argument(EMPTY_MAT_MESSAGE);
     }
 
+    frame_context context(src);
     playing_field_localizer plf_loc;
-    plf_loc.localize(src);
+    plf_loc.localize(context);
     balls_localizer blls_loc(plf_loc.get_localization());
-    blls_loc.localize(src);
+    blls_loc.localize(context);
+    playing_field_localization plf_localization;
+    map_to_source(plf_loc.get_localization(), context.get_resolution(), plf_localization);
 
     Mat frame_segmentation;
     get_frame_segmentation(src, frame_segmentation);
     color_segmentation(src, dst, frame_segmentation, preserve_background);
 
     // Draw yellow lines
-    vector<Point> corners = plf_loc.get_localization().corners;
+    vector<Point> corners = plf_localization.corners;
     for (size_t i = 0; i < corners.size(); i++)
     {
         const Scalar YELLOW_COLOR = Scalar(0, 255, 255);
@@ -47,7 +50,7 @@ void get_colored_frame_segmentation(const Mat &src, Mat &dst, bool preserve_back
     }
 }
 
-void get_frame_segmentation(const Mat &src, Mat &dst)
+void get_frame_segmentation(const Mat &src, Mat &dst, const balls_localizer_options &options)
 {
     if (src.empty())
     {
@@ -56,15 +59,26 @@ void get_frame_segmentation(const Mat &src, Mat &dst)
     }
 
     // Perform localizations
-    playing_field_localizer plf_localizer;
-    plf_localizer.localize(src);
-    playing_field_localization plf_localization = plf_localizer.get_localization();
-    balls_localizer blls_localizer(plf_localization);
-    blls_localizer.localize(src);
-    balls_localization blls_localization = blls_localizer.get_localization();
+    frame_context context(src);
+    playing_field_localizer_options plf_options;
+    plf_options.crop_to_table = options.crop_to_table;
+    playing_field_localizer plf_localizer(plf_options);
+    plf_localizer.localize(context);
+    balls_localizer blls_localizer(plf_localizer.get_localization(), options);
+    blls_localizer.localize(context);
+
+    // The segmentation is at the source resolution
+    playing_field_localization plf_localization;
+    balls_localization blls_localization;
+    map_to_source(plf_localizer.get_localization(), context.get_resolution(), plf_localization);
+    map_to_source(blls_localizer.get_localization(), context.get_resolution(), blls_localization);
+    draw_frame_segmentation(plf_localization, blls_localization, src.size(), dst);
+}
 
+void draw_frame_segmentation(const playing_field_localization &plf_localization, const balls_localization &blls_localization, Size size, Mat &dst)
+{
     // Set masks for segmentation evaluation
-    Mat segmentation(src.size(), CV_8UC1);
+    Mat segmentation(size, CV_8UC1);
     segmentation.setTo(Scalar(label_id::background));
     segmentation.setTo(Scalar(label_id::playing_field), plf_localization.mask);
 
@@ -14,12 +14,51 @@ namespace fs = std::filesystem;
 
 int main(int argc, char **argv)
 {
-    if (argc < 2)
+    if (argc < 2 || argc > 10)
     {
-        cerr << "Wrong number of parameters. Insert the dataset location." << endl;
+        cerr << "Wrong number of parameters. Insert the dataset location and optionally the candidate generator (--candidates=hough or --candidates=distance_transform), the pyramid levels of the ball candidates (--pyramid=0, --pyramid=1 or --pyramid=2), the processing of the table box only (--crop), the processing of the rectified table (--rectify), the parallel localization of the frames (--parallel), the color clustering of a subset of the pixels (--kmeans-subsample), the color clustering starting from the centers of the previous frame (--kmeans-warm-start) and the circle filters ordered by their cost measured on the dataset (--rank-filters)." << endl;
         return 1;
     }
 
+    balls_localizer_options options;
+    playing_field_localizer_options plf_options;
+    int workers = 1;
+    bool rank_filters = false;
+    for (int i = 2; i < argc; i++)
+    {
+        const string OPTION = static_cast<string>(argv[i]);
+        if (OPTION == "--candidates=hough")
+            options.generator = hough_generator;
+        else if (OPTION == "--candidates=distance_transform")
+            options.generator = distance_transform_generator;
+        else if (OPTION == "--pyramid=0")
+            options.pyramid_levels = 0;
+        else if (OPTION == "--pyramid=1")
+            options.pyramid_levels = 1;
+        else if (OPTION == "--pyramid=2")
+            options.pyramid_levels = 2;
+        else if (OPTION == "--crop")
+            options.crop_to_table = true;
+        else if (OPTION == "--rectify")
+            options.rectify_table = true;
+        else if (OPTION == "--parallel")
+            workers = max(getNumThreads(), 1);
+        else if (OPTION == "--kmeans-subsample")
+        {
+            const int KMEANS_SAMPLE_STEP = 4;
+            plf_options.kmeans_sample_step = KMEANS_SAMPLE_STEP;
+        }
+        else if (OPTION == "--kmeans-warm-start")
+            plf_options.kmeans_warm_start = true;
+        else if (OPTION == "--rank-filters")
+            rank_filters = true;
+        else
+        {
+            cerr << "Unknown option " << OPTION << "." << endl;
+            return 1;
+        }
+    }
+
     string dataset_path = static_cast<string>(argv[1]);
     if (!fs::is_directory(dataset_path))
     {
@@ -33,7 +72,10 @@ int main(int argc, char **argv)
     
     try
     {
-        evaluate(dataset_path);
+        // A first localization of the dataset measures the circle filters, which are then ordered by their cost
+        if (rank_filters)
+            rank_circle_filters(dataset_path, options, workers, plf_options, options.filters_order);
+        evaluate(dataset_path, options, workers, plf_options);
     }
     catch (const exception &e)
     {
@@ -117,4 +117,15 @@ double intercept(const std::pair<cv::Point, cv::Point> &line)
     Point pt_1 = line.first;
     Point pt_2 = line.second;
     return pt_1.y - pt_1.x * angular_coefficient({pt_1, pt_2});
-}
\ No newline at end of file
+}
+
+Vec2f get_polar_line(const Point2f &point, const Point2f &direction)
+{
+    // The normal (cos(theta), sin(theta)) is orthogonal to the direction, taken in the half plane of theta in [0, pi)
+    double theta = atan2(direction.x, -direction.y);
+    if (theta < 0)
+        theta += CV_PI;
+    if (theta >= CV_PI)
+        theta -= CV_PI;
+    return Vec2f(point.x * cos(theta) + point.y * sin(theta), theta);
+}
@@ -0,0 +1,203 @@
+// Author: Nicola Maritan 2121717
+
+#include "hsv_band_classifier.h"
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+
+using namespace cv;
+using namespace std;
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+/**
+ * @brief Splits 16 interleaved HSV pixels into their hue, saturation and value channels.
+ *
+ * @param hsv Pointer to 48 bytes of interleaved HSV pixels.
+ * @param hue Output hue channel.
+ * @param saturation Output saturation channel.
+ * @param value Output value channel.
+ */
+static inline void deinterleave_hsv(const uchar *hsv, __m128i &hue, __m128i &saturation, __m128i &value)
+{
+    const __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i *>(hsv));
+    const __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i *>(hsv + 16));
+    const __m128i third = _mm_loadu_si128(reinterpret_cast<const __m128i *>(hsv + 32));
+
+    // Each channel gathers its bytes from the three registers, -1 entries are zeroed by the shuffle.
+    hue = _mm_or_si128(_mm_or_si128(
+                           _mm_shuffle_epi8(first, _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+                           _mm_shuffle_epi8(second, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1))),
+                       _mm_shuffle_epi8(third, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13)));
+    saturation = _mm_or_si128(_mm_or_si128(
+                                  _mm_shuffle_epi8(first, _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+                                  _mm_shuffle_epi8(second, _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1))),
+                              _mm_shuffle_epi8(third, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14)));
+    value = _mm_or_si128(_mm_or_si128(
+                             _mm_shuffle_epi8(first, _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+                             _mm_shuffle_epi8(second, _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1))),
+                         _mm_shuffle_epi8(third, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15)));
+}
+#endif
+
+#if defined(__AVX2__)
+/**
+ * @brief Checks which unsigned bytes lie within a range, bounds included.
+ *
+ * @return 0xFF for the bytes within the range, 0 otherwise.
+ */
+static inline __m256i in_range(__m256i x, __m256i lowerbound, __m256i upperbound)
+{
+    return _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(x, lowerbound), x), _mm256_cmpeq_epi8(_mm256_min_epu8(x, upperbound), x));
+}
+#elif defined(__SSE4_1__)
+/**
+ * @brief Checks which unsigned bytes lie within a range, bounds included.
+ *
+ * @return 0xFF for the bytes within the range, 0 otherwise.
+ */
+static inline __m128i in_range(__m128i x, __m128i lowerbound, __m128i upperbound)
+{
+    return _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(x, lowerbound), x), _mm_cmpeq_epi8(_mm_min_epu8(x, upperbound), x));
+}
+#endif
+
+hsv_band_classifier::hsv_band_classifier(const vector<hsv_range> &bands)
+    : bands{bands}
+{
+    if (bands.empty() || bands.size() > MAX_BANDS)
+    {
+        const string INVALID_BANDS = "Invalid number of bands for the HSV band classifier.";
+        throw invalid_argument(INVALID_BANDS);
+    }
+}
+
+void hsv_band_classifier::classify(const Mat &hsv, Mat &dst, const vector<Mat> &band_masks) const
+{
+    if (hsv.type() != CV_8UC3)
+    {
+        const string INVALID_HSV = "Argument does not represent an HSV image.";
+        throw invalid_argument(INVALID_HSV);
+    }
+
+    if (!band_masks.empty() && band_masks.size() != bands.size())
+    {
+        const string INVALID_BAND_MASKS = "Band masks do not match the bands in number.";
+        throw invalid_argument(INVALID_BAND_MASKS);
+    }
+
+    for (const Mat &band_mask : band_masks)
+    {
+        if (!band_mask.empty() && (band_mask.type() != CV_8UC1 || band_mask.size() != hsv.size()))
+        {
+            const string INVALID_MASK = "Argument does not represent a mask.";
+            throw invalid_argument(INVALID_MASK);
+        }
+    }
+
+    dst.create(hsv.size(), CV_8U);
+
+    const uchar *band_masks_rows[MAX_BANDS] = {nullptr};
+    for (int row = 0; row < hsv.rows; row++)
+    {
+        for (int band = 0; band < band_masks.size(); band++)
+            band_masks_rows[band] = band_masks[band].empty() ? nullptr : band_masks[band].ptr<uchar>(row);
+
+        classify_row(hsv.ptr<uchar>(row), band_masks_rows, dst.ptr<uchar>(row), hsv.cols);
+    }
+}
+
+void hsv_band_classifier::classify_row(const uchar *hsv, const uchar *const *band_masks, uchar *dst, int length) const
+{
+    const int number_of_bands = static_cast<int>(bands.size());
+    int col = 0;
+
+#if defined(__AVX2__)
+    __m256i lowerbounds[MAX_BANDS][3], upperbounds[MAX_BANDS][3];
+    for (int band = 0; band < number_of_bands; band++)
+    {
+        for (int channel = 0; channel < 3; channel++)
+        {
+            lowerbounds[band][channel] = _mm256_set1_epi8(static_cast<char>(bands[band].lowerbound[channel]));
+            upperbounds[band][channel] = _mm256_set1_epi8(static_cast<char>(bands[band].upperbound[channel]));
+        }
+    }
+
+    const __m256i zero = _mm256_setzero_si256();
+    for (; col + 32 <= length; col += 32)
+    {
+        __m128i hue_low, saturation_low, value_low, hue_high, saturation_high, value_high;
+        deinterleave_hsv(hsv + 3 * col, hue_low, saturation_low, value_low);
+        deinterleave_hsv(hsv + 3 * (col + 16), hue_high, saturation_high, value_high);
+        const __m256i channels[3] = {_mm256_inserti128_si256(_mm256_castsi128_si256(hue_low), hue_high, 1),
+                                     _mm256_inserti128_si256(_mm256_castsi128_si256(saturation_low), saturation_high, 1),
+                                     _mm256_inserti128_si256(_mm256_castsi128_si256(value_low), value_high, 1)};
+
+        __m256i classification = zero;
+        for (int band = 0; band < number_of_bands; band++)
+        {
+            __m256i in_band = _mm256_and_si256(_mm256_and_si256(in_range(channels[0], lowerbounds[band][0], upperbounds[band][0]),
+                                                                in_range(channels[1], lowerbounds[band][1], upperbounds[band][1])),
+                                               in_range(channels[2], lowerbounds[band][2], upperbounds[band][2]));
+            if (band_masks != nullptr && band_masks[band] != nullptr)
+            {
+                const __m256i allowed = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(band_masks[band] + col));
+                in_band = _mm256_andnot_si256(_mm256_cmpeq_epi8(allowed, zero), in_band);
+            }
+            classification = _mm256_or_si256(classification, in_band);
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + col), classification);
+    }
+#elif defined(__SSE4_1__)
+    __m128i lowerbounds[MAX_BANDS][3], upperbounds[MAX_BANDS][3];
+    for (int band = 0; band < number_of_bands; band++)
+    {
+        for (int channel = 0; channel < 3; channel++)
+        {
+            lowerbounds[band][channel] = _mm_set1_epi8(static_cast<char>(bands[band].lowerbound[channel]));
+            upperbounds[band][channel] = _mm_set1_epi8(static_cast<char>(bands[band].upperbound[channel]));
+        }
+    }
+
+    const __m128i zero = _mm_setzero_si128();
+    for (; col + 16 <= length; col += 16)
+    {
+        __m128i channels[3];
+        deinterleave_hsv(hsv + 3 * col, channels[0], channels[1], channels[2]);
+
+        __m128i classification = zero;
+        for (int band = 0; band < number_of_bands; band++)
+        {
+            __m128i in_band = _mm_and_si128(_mm_and_si128(in_range(channels[0], lowerbounds[band][0], upperbounds[band][0]),
+                                                          in_range(channels[1], lowerbounds[band][1], upperbounds[band][1])),
+                                            in_range(channels[2], lowerbounds[band][2], upperbounds[band][2]));
+            if (band_masks != nullptr && band_masks[band] != nullptr)
+            {
+                const __m128i allowed = _mm_loadu_si128(reinterpret_cast<const __m128i *>(band_masks[band] + col));
+                in_band = _mm_andnot_si128(_mm_cmpeq_epi8(allowed, zero), in_band);
+            }
+            classification = _mm_or_si128(classification, in_band);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + col), classification);
+    }
+#endif
+
+    // Scalar classification of the remaining pixels
+    for (; col < length; col++)
+    {
+        const uchar *pixel = hsv + 3 * col;
+        uchar classification = 0;
+        for (int band = 0; band < number_of_bands && classification == 0; band++)
+        {
+            if (band_masks != nullptr && band_masks[band] != nullptr && band_masks[band][col] == 0)
+                continue;
+
+            const hsv_range &range = bands[band];
+            if (pixel[0] >= range.lowerbound[0] && pixel[0] <= range.upperbound[0] &&
+                pixel[1] >= range.lowerbound[1] && pixel[1] <= range.upperbound[1] &&
+                pixel[2] >= range.lowerbound[2] && pixel[2] <= range.upperbound[2])
+                classification = 255;
+        }
+        dst[col] = classification;
+    }
+}
@@ -344,13 +344,23 @@ float evaluate_balls_and_playing_field_segmentation(const cv::Mat &found_mask, c
 
 void get_balls_localization(const Mat &src, balls_localization &localization)
 {
-    playing_field_localizer plf_localizer;
-    plf_localizer.localize(src);
+    vector<circle_filter_statistics> filters_statistics;
+    get_balls_localization(src, localization, filters_statistics);
+}
+
+void get_balls_localization(const Mat &src, balls_localization &localization, vector<circle_filter_statistics> &filters_statistics, const balls_localizer_options &options)
+{
+    frame_context context(src);
+    playing_field_localizer_options plf_options;
+    plf_options.crop_to_table = options.crop_to_table;
+    playing_field_localizer plf_localizer(plf_options);
+    plf_localizer.localize(context);
     playing_field_localization plf_localization = plf_localizer.get_localization();
 
-    balls_localizer blls_localizer(plf_localization);
-    blls_localizer.localize(src);
-    localization = blls_localizer.get_localization();
+    balls_localizer blls_localizer(plf_localization, options);
+    blls_localizer.localize(context);
+    map_to_source(blls_localizer.get_localization(), context.get_resolution(), localization);
+    filters_statistics = blls_localizer.get_filters_statistics();
 }
 
 void load_ground_truth_localization(const string &filename, balls_localization &ground_truth_localization)
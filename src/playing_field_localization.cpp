@@ -20,36 +20,51 @@ void playing_field_localizer::localize(const Mat &src)
         throw invalid_argument(EMPTY_MAT_MESSAGE);
     }
 
-    const int FILTER_SIZE = 3;
-    const int FILTER_SIGMA = 20;
-    Mat blurred;
-    GaussianBlur(src.clone(), blurred, Size(FILTER_SIZE, FILTER_SIZE), FILTER_SIGMA, FILTER_SIGMA);
+    frame_context context(src);
+    localize(context);
+}
 
-    Mat segmented, labels;
-    segmentation(blurred, segmented);
+void playing_field_localizer::localize(frame_context &context)
+{
+    const Mat &src = context.get_frame();
+    resolution_scale = context.get_resolution().scale;
 
+    // The images of the previous localization may be shared by its copies, so a new localization is built
+    localization = playing_field_localization();
+
+    segmentation(context, segmented);
+
+    // The board color is the most frequent cluster around the center, always one of the clusters
     const int RADIUS = 30;
-    Vec3b board_color = get_playing_field_color(segmented, RADIUS);
+    const Point CENTER = Point(segmented.cols / 2, segmented.rows / 2);
+    Vec3b board_color = color_estimator.estimate(segmented, CENTER, get_scaled_length(RADIUS, resolution_scale), Mat(), mode_estimate);
 
-    Mat mask;
     inRange(segmented, board_color, board_color, mask);
     segmented.setTo(Scalar(0, 0, 0), mask);
 
-    non_maxima_connected_component_suppression(mask.clone(), mask);
-
-    const int THRESHOLD_1_CANNY = 50;
-    const int THRESHOLD_2_CANNY = 150;
-    Mat edges;
-    Canny(mask, edges, THRESHOLD_1_CANNY, THRESHOLD_2_CANNY);
+    Rect component_box;
+    non_maxima_connected_component_suppression(mask.clone(), mask, component_box);
 
-    vector<Vec3f> lines, refined_lines;
-    find_lines(edges, lines);
-    refine_lines(lines, refined_lines);
+    // The table margin holds the circles out of the field checked by the balls localizer, with their edges
+    const int TABLE_BOX_MARGIN = 40;
+    const Rect FRAME_RECT = Rect(Point(0, 0), src.size());
+    const int table_box_margin = get_scaled_length(TABLE_BOX_MARGIN, resolution_scale);
+    const Rect edges_box = options.crop_to_table ? get_margined_box(component_box, table_box_margin, src.size()) : FRAME_RECT;
 
-    draw_lines(edges, refined_lines);
+    // The edges of the table are voted by the pixels of the outer contour of its component
+    findContours(mask(edges_box), contours, RETR_EXTERNAL, CHAIN_APPROX_NONE, edges_box.tl());
+    const vector<Point> NO_CONTOUR;
+    const vector<Point> &table_contour = contours.empty() ? NO_CONTOUR : *max_element(contours.begin(), contours.end(), [](const vector<Point> &a, const vector<Point> &b)
+                                                                                        { return a.size() < b.size(); });
 
+    // Most components are a clean quadrilateral, whose corners come from the contour directly
     vector<Point> refined_lines_intersections;
-    intersections(refined_lines, refined_lines_intersections, src.rows, src.cols);
+    if (!fit_table_polygon(table_contour, src.size(), refined_lines_intersections))
+    {
+        vector<Vec3f> lines;
+        find_lines(table_contour, src.size(), lines);
+        find_corners(lines, src.size(), refined_lines_intersections);
+    }
 
     sort_points_clockwise(refined_lines_intersections);
     localization.corners = refined_lines_intersections;
@@ -58,111 +73,319 @@ void playing_field_localizer::localize(const Mat &src)
     estimate_holes_location(hole_points);
     localization.hole_points = hole_points;
 
+    localization.table_box = get_margined_box(refined_lines_intersections.empty() ? Rect() : boundingRect(refined_lines_intersections), table_box_margin, src.size());
+    const Rect table_box = options.crop_to_table ? localization.table_box : FRAME_RECT;
+
     Mat table_mask(Size(src.cols, src.rows), CV_8U);
     table_mask.setTo(0);
     fillConvexPoly(table_mask, refined_lines_intersections, 255);
     localization.mask = table_mask;
+
+    // Out of the box the field has no pixels, so the cushion distance is computed on the box only
+    localization.cushion_distance.create(src.size(), CV_16U);
+    if (table_box != FRAME_RECT)
+        localization.cushion_distance.setTo(0);
+    Mat table_cushion_distance = localization.cushion_distance(table_box);
+    compute_cushion_distance(table_mask(table_box), table_cushion_distance);
+    estimate_table_homography(localization.table_homography);
+    estimate_ball_radius_by_row(table_mask, table_box, localization.ball_radius_by_row);
 }
 
-void playing_field_localizer::segmentation(const Mat &src, Mat &dst)
+void playing_field_localizer::segmentation(frame_context &context, Mat &dst)
 {
     // HSV allows to separate brightness from other color characteristics, therefore
     // it is employed for kmeans clustering.
-    cvtColor(src, dst, COLOR_BGR2HSV);
+    const int FILTER_SIZE = 3;
+    const int FILTER_SIGMA = 20;
+    const vector<Mat> &blurred_hsv_channels = context.get_blurred_hsv_channels(get_scaled_filter_size(FILTER_SIZE, resolution_scale), FILTER_SIGMA * resolution_scale);
 
-    // Apply uniform Value (of HSV) for the whole image, to handle different brightnesses
+    // Apply uniform Value (of HSV) for the whole image, to handle different brightnesses.
+    // Since the Value is uniform, the pixels are clustered by their Hue and Saturation only,
+    // through their histogram, and the shared channels are not modified.
     const int VALUE_UNIFORM = 128;
-    vector<Mat> hsv_channels;
-    split(dst, hsv_channels);
-    hsv_channels[2].setTo(VALUE_UNIFORM);
-    merge(hsv_channels, dst);
-
     const int CENTERS = 3;
-    kmeans(dst.clone(), dst, CENTERS);
+    kmeans_clusterer.cluster(blurred_hsv_channels[0], blurred_hsv_channels[1], VALUE_UNIFORM, dst, CENTERS);
 }
 
-void playing_field_localizer::find_lines(const Mat &edges, vector<Vec3f> &lines)
+bool playing_field_localizer::fit_table_polygon(const vector<Point> &contour, Size size, vector<Point> &corners)
 {
-    const float RHO_RESOLUTION = 1.5;   // In pixels.
-    const float THETA_RESOLUTION = 1.8; // In radians.
-    const int THRESHOLD = 110;
+    corners.clear();
+    const int TABLE_EDGES = 4;
+    if (contour.size() < TABLE_EDGES)
+        return false;
+
+    // The tolerance grows until the hull is reduced to a quadrilateral, or to fewer vertices
+    convexHull(contour, table_hull);
+    const double perimeter = arcLength(table_hull, true);
+    const float APPROXIMATION_TOLERANCES[] = {0.01, 0.02, 0.03, 0.04}; // Fractions of the perimeter.
+    double tolerance = 0;
+    for (float approximation_tolerance : APPROXIMATION_TOLERANCES)
+    {
+        tolerance = approximation_tolerance * perimeter;
+        approxPolyDP(table_hull, table_polygon, tolerance, true);
+        if (table_polygon.size() <= TABLE_EDGES)
+            break;
+    }
+
+    // Validation of the quadrilateral against the component
+    if (table_polygon.size() != TABLE_EDGES || !isContourConvex(table_polygon))
+        return false;
+
+    const double component_area = contourArea(contour);
+    const float MAX_AREA_DIFFERENCE = 0.05; // Fraction of the component area.
+    if (component_area <= 0 || abs(contourArea(table_polygon) - component_area) > MAX_AREA_DIFFERENCE * component_area)
+        return false;
+
+    double side_lengths[TABLE_EDGES];
+    for (int side = 0; side < TABLE_EDGES; side++)
+        side_lengths[side] = norm(table_polygon[(side + 1) % TABLE_EDGES] - table_polygon[side]);
+    const double aspect = (side_lengths[0] + side_lengths[2]) / (side_lengths[1] + side_lengths[3]);
+    const float MAX_ASPECT = 4;
+    if (aspect > MAX_ASPECT || aspect < 1 / MAX_ASPECT)
+        return false;
+
+    // Each side is fitted to the contour pixels within the tolerance from it, excluding its ends. The robust fit
+    // discounts the dents of the band, then the side is refitted to the pixels close to the fitted line only.
+    const float SIDE_MARGIN = 0.15; // Fraction of the side length excluded at each end.
+    const int INLIER_DISTANCE = 3;
+    const int inlier_distance = get_scaled_length(INLIER_DISTANCE, resolution_scale);
+    vector<Vec3f> sides;
+    for (int side = 0; side < TABLE_EDGES; side++)
+    {
+        const Point2f start = table_polygon[side];
+        const Point2f direction = (Point2f(table_polygon[(side + 1) % TABLE_EDGES]) - start) / side_lengths[side];
+        const Point2f normal(-direction.y, direction.x);
+        edge_inliers.clear();
+        for (const Point &pixel : contour)
+        {
+            const Point2f offset = Point2f(pixel) - start;
+            const double along = offset.dot(direction) / side_lengths[side];
+            if (along > SIDE_MARGIN && along < 1 - SIDE_MARGIN && abs(offset.dot(normal)) <= tolerance)
+                edge_inliers.push_back(pixel);
+        }
+        if (edge_inliers.size() < 2)
+            return false;
 
-    Mat cdst;
-    cvtColor(edges, cdst, COLOR_GRAY2BGR);
-    HoughLines(edges, lines, RHO_RESOLUTION, THETA_RESOLUTION * CV_PI / 180, THRESHOLD, 0, 0);
+        Vec4f fitted_line;
+        fitLine(edge_inliers, fitted_line, DIST_HUBER, 0, 0.01, 0.01);
+        const Point2f line_point(fitted_line[2], fitted_line[3]);
+        const Point2f line_normal(-fitted_line[1], fitted_line[0]);
+        size_t close_inliers = 0;
+        for (const Point &pixel : edge_inliers)
+        {
+            if (abs((Point2f(pixel) - line_point).dot(line_normal)) <= inlier_distance)
+                edge_inliers[close_inliers++] = pixel;
+        }
+        if (close_inliers >= 2)
+        {
+            edge_inliers.resize(close_inliers);
+            fitLine(edge_inliers, fitted_line, DIST_L2, 0, 0.01, 0.01);
+        }
+
+        const Vec2f line = get_polar_line(Point2f(fitted_line[2], fitted_line[3]), Point2f(fitted_line[0], fitted_line[1]));
+        sides.push_back(Vec3f(line[0], line[1], edge_inliers.size()));
+    }
+
+    // Adjacent sides meet at the corners
+    vector<pair<Point, Point>> side_points;
+    get_pairs_points_per_line(sides, side_points);
+    for (int side = 0; side < TABLE_EDGES; side++)
+    {
+        Point corner;
+        if (!intersection(side_points[(side + TABLE_EDGES - 1) % TABLE_EDGES], side_points[side], corner, size.height, size.width))
+        {
+            corners.clear();
+            return false;
+        }
+        corners.push_back(corner);
+    }
+    return true;
 }
 
-void playing_field_localizer::refine_lines(const vector<Vec3f> &lines, vector<Vec3f> &refined_lines)
+void playing_field_localizer::find_lines(const vector<Point> &contour, Size size, vector<Vec3f> &lines)
 {
-    const float RHO_THRESHOLD = 40;
-    const float THETA_THRESHOLD = 0.5;
-    vector<Vec3f> lines_copy = lines;
+    lines.clear();
+    const int contour_size = contour.size();
+    if (contour_size == 0)
+        return;
 
-    while (!lines_copy.empty())
+    if (theta_cos.empty())
     {
-        Vec3f reference_line = lines_copy.back();
-        lines_copy.pop_back();
-        vector<Vec3f> similar_lines;
+        for (int theta_bin = 0; theta_bin < THETA_BINS; theta_bin++)
+        {
+            const double theta = (THETA_ORIGIN + theta_bin) * CV_PI / 180;
+            theta_cos.push_back(cos(theta));
+            theta_sin.push_back(sin(theta));
+        }
+    }
 
-        dump_similar_lines(reference_line, lines_copy, similar_lines, RHO_THRESHOLD, THETA_THRESHOLD);
+    // Normal of the contour at each pixel, orthogonal to the chord between the pixels a few steps before and after it
+    const int NORMAL_STEP = 5;
+    const int normal_step = get_scaled_length(NORMAL_STEP, resolution_scale) % contour_size;
+    contour_normals.resize(contour_size);
+    for (int i = 0; i < contour_size; i++)
+    {
+        const Point chord = contour[(i + normal_step) % contour_size] - contour[(i - normal_step + contour_size) % contour_size];
+        float normal = atan2(chord.x, -chord.y) * 180 / CV_PI - THETA_ORIGIN;
+        normal = fmod(normal, THETA_BINS);
+        contour_normals[i] = (normal < 0 ? normal + THETA_BINS : normal) + THETA_ORIGIN;
+    }
 
-        // Compute a new mean line with the dumped ones
-        Vec3f mean_line;
-        int total_votes = 0;
-        for (Vec3f similar_line : similar_lines)
+    // Each pixel votes for the orientations around its normal, a bin past the range being the opposite line
+    max_rho = cvCeil(hypot(size.width, size.height));
+    accumulator.create(THETA_BINS, 2 * max_rho + 1, CV_32F);
+    accumulator.setTo(0);
+    for (int i = 0; i < contour_size; i++)
+    {
+        const int normal_bin = cvRound(contour_normals[i] - THETA_ORIGIN);
+        for (int offset = -THETA_WINDOW; offset <= THETA_WINDOW; offset++)
         {
-            total_votes += similar_line[2];
-            mean_line += similar_line * similar_line[2];
+            const int theta_bin = (normal_bin + offset + THETA_BINS) % THETA_BINS;
+            const int rho = cvRound(contour[i].x * theta_cos[theta_bin] + contour[i].y * theta_sin[theta_bin]);
+            accumulator.at<float>(theta_bin, rho + max_rho)++;
         }
-        mean_line[0] /= total_votes;
-        mean_line[1] /= total_votes;
-        refined_lines.push_back(mean_line);
+    }
+
+    // The votes of an edge spread over neighboring cells, so the peaks are found on the votes of the clusters
+    boxFilter(accumulator, clustered_votes, -1, Size(3, 3), Point(-1, -1), false, BORDER_CONSTANT);
+
+    const int TABLE_EDGES = 4;
+    const int THRESHOLD = 110;
+    const int threshold = get_scaled_length(THRESHOLD, resolution_scale);
+    while (static_cast<int>(lines.size()) < TABLE_EDGES)
+    {
+        double votes;
+        Point peak;
+        minMaxLoc(clustered_votes, nullptr, &votes, nullptr, &peak);
+        if (votes < threshold)
+            break;
+
+        lines.push_back(refine_peak(peak.y, peak.x - max_rho, votes, contour));
+        suppress_peak(peak.y, peak.x - max_rho);
     }
 }
 
-void playing_field_localizer::draw_lines(const Mat &src, const vector<Vec3f> &lines)
+Vec3f playing_field_localizer::refine_peak(int theta_bin, int rho, float votes, const vector<Point> &contour)
 {
-    Mat src_bgr;
-    cvtColor(src, src_bgr, COLOR_GRAY2BGR);
-    const float ARBITRARY_COORDINATE = 1000; // Arbitrary constant for line plotting
+    // Vote weighted mean of the cluster, bins past the orientation range being read as the opposite lines
+    const int PEAK_RADIUS = 2;
+    double weight = 0, theta_sum = 0, rho_sum = 0;
+    for (int theta_offset = -PEAK_RADIUS; theta_offset <= PEAK_RADIUS; theta_offset++)
+    {
+        for (int rho_offset = -PEAK_RADIUS; rho_offset <= PEAK_RADIUS; rho_offset++)
+        {
+            const float cell_votes = get_votes(theta_bin + theta_offset, rho + rho_offset);
+            weight += cell_votes;
+            theta_sum += cell_votes * (theta_bin + theta_offset);
+            rho_sum += cell_votes * (rho + rho_offset);
+        }
+    }
+    const double theta_degrees = THETA_ORIGIN + theta_sum / weight;
+    const double theta = theta_degrees * CV_PI / 180;
+    const double rho_mean = rho_sum / weight;
+    const Point2f normal(cos(theta), sin(theta));
+    Vec2f line = get_polar_line(normal * rho_mean, Point2f(-normal.y, normal.x));
+
+    // Least squares fit of the contour pixels of the edge, close to the line and with a similar normal
+    const int INLIER_DISTANCE = 3;
+    const int inlier_distance = get_scaled_length(INLIER_DISTANCE, resolution_scale);
+    edge_inliers.clear();
+    for (size_t i = 0; i < contour.size(); i++)
+    {
+        const double distance = abs(contour[i].x * normal.x + contour[i].y * normal.y - rho_mean);
+        const double normal_difference = abs(remainder(contour_normals[i] - theta_degrees, THETA_BINS));
+        if (distance <= inlier_distance && normal_difference <= THETA_WINDOW)
+            edge_inliers.push_back(contour[i]);
+    }
+    if (edge_inliers.size() >= 2)
+    {
+        Vec4f fitted_line;
+        fitLine(edge_inliers, fitted_line, DIST_L2, 0, 0.01, 0.01);
+        line = get_polar_line(Point2f(fitted_line[2], fitted_line[3]), Point2f(fitted_line[0], fitted_line[1]));
+    }
+
+    return Vec3f(line[0], line[1], votes);
+}
+
+void playing_field_localizer::suppress_peak(int theta_bin, int rho)
+{
+    // Same similarity thresholds of the merging of the HoughLines lines
+    const float RHO_THRESHOLD = 40;
+    const float THETA_THRESHOLD = 0.5; // In radians.
+    const int rho_threshold = get_scaled_length(RHO_THRESHOLD, resolution_scale);
+    const int theta_threshold = cvRound(THETA_THRESHOLD * 180 / CV_PI);
+    for (int theta_offset = -theta_threshold; theta_offset <= theta_threshold; theta_offset++)
+    {
+        int suppressed_bin = theta_bin + theta_offset;
+        int suppressed_rho = rho;
+        if (suppressed_bin < 0 || suppressed_bin >= THETA_BINS)
+        {
+            suppressed_bin = (suppressed_bin + THETA_BINS) % THETA_BINS;
+            suppressed_rho = -rho;
+        }
+        const int start = max(suppressed_rho - rho_threshold + max_rho, 0);
+        const int end = min(suppressed_rho + rho_threshold + max_rho + 1, clustered_votes.cols);
+        if (start < end)
+            clustered_votes.row(suppressed_bin).colRange(start, end).setTo(0);
+    }
+}
 
-    for (size_t i = 0; i < lines.size(); i++)
+float playing_field_localizer::get_votes(int theta_bin, int rho) const
+{
+    if (theta_bin < 0 || theta_bin >= THETA_BINS)
     {
-        float rho = lines[i][0], theta = lines[i][1];
-        Point pt1, pt2;
-        double a = cos(theta), b = sin(theta);
-        double x0 = a * rho, y0 = b * rho;
-        pt1.x = cvRound(x0 + ARBITRARY_COORDINATE * (-b));
-        pt1.y = cvRound(y0 + ARBITRARY_COORDINATE * (a));
-        pt2.x = cvRound(x0 - ARBITRARY_COORDINATE * (-b));
-        pt2.y = cvRound(y0 - ARBITRARY_COORDINATE * (a));
-        const Scalar RED = Scalar(0, 255, 0);
-        line(src_bgr, pt1, pt2, RED, 1, LINE_AA);
+        theta_bin = (theta_bin + THETA_BINS) % THETA_BINS;
+        rho = -rho;
     }
+    if (rho < -max_rho || rho > max_rho)
+        return 0;
+    return accumulator.at<float>(theta_bin, rho + max_rho);
 }
 
-void playing_field_localizer::dump_similar_lines(const Vec3f &reference_line, vector<Vec3f> &lines, vector<Vec3f> &similar_lines, float rho_threshold, float theta_threshold)
+void playing_field_localizer::find_corners(const vector<Vec3f> &lines, Size size, vector<Point> &corners)
 {
-    similar_lines.push_back(reference_line);
+    corners.clear();
+    if (lines.size() < 2)
+        return;
+    if (lines.size() != 4)
+    {
+        intersections(lines, corners, size.height, size.width);
+        return;
+    }
 
-    // Insert into similar_lines all the similar lines and removes them from lines.
-    int i = 0;
-    while (i < lines.size())
+    // Opposite edges are the couples with the most similar orientations, whose own intersection is not a corner
+    const int PAIRINGS[3][4] = {{0, 1, 2, 3}, {0, 2, 1, 3}, {0, 3, 1, 2}};
+    int best_pairing = 0;
+    float min_difference = numeric_limits<float>::max();
+    for (int pairing = 0; pairing < 3; pairing++)
     {
-        Vec3f line = lines.at(i);
-        if (abs(line[0] - reference_line[0]) < rho_threshold && abs(line[1] - reference_line[1]) < theta_threshold)
+        float difference = 0;
+        for (int couple = 0; couple < 2; couple++)
         {
-            similar_lines.push_back(line);
-            lines.erase(lines.begin() + i);
+            const float theta_difference = abs(lines[PAIRINGS[pairing][2 * couple]][1] - lines[PAIRINGS[pairing][2 * couple + 1]][1]);
+            difference += min(theta_difference, static_cast<float>(CV_PI) - theta_difference);
         }
-        else
+        if (difference < min_difference)
+        {
+            min_difference = difference;
+            best_pairing = pairing;
+        }
+    }
+
+    vector<pair<Point, Point>> line_points;
+    get_pairs_points_per_line(lines, line_points);
+    for (int i = 0; i < 2; i++)
+    {
+        for (int j = 2; j < 4; j++)
         {
-            i++;
+            Point corner;
+            if (intersection(line_points[PAIRINGS[best_pairing][i]], line_points[PAIRINGS[best_pairing][j]], corner, size.height, size.width))
+                corners.push_back(corner);
         }
     }
 }
 
-void playing_field_localizer::non_maxima_connected_component_suppression(const Mat &src, Mat &dst)
+void playing_field_localizer::non_maxima_connected_component_suppression(const Mat &src, Mat &dst, Rect &component_box)
 {
     if (src.type() != CV_8UC1)
     {
@@ -189,6 +412,11 @@ void playing_field_localizer::non_maxima_connected_component_suppression(const M
         }
     }
 
+    component_box = Rect();
+    if (max_label_component < stats.rows)
+        component_box = Rect(stats.at<int>(max_label_component, CC_STAT_LEFT), stats.at<int>(max_label_component, CC_STAT_TOP),
+                             stats.at<int>(max_label_component, CC_STAT_WIDTH), stats.at<int>(max_label_component, CC_STAT_HEIGHT));
+
     // Suppress (mask set to 0) all components with non greatest area
     for (int row = 0; row < src.rows; row++)
     {
@@ -202,6 +430,15 @@ void playing_field_localizer::non_maxima_connected_component_suppression(const M
     }
 }
 
+Rect playing_field_localizer::get_margined_box(const Rect &box, int margin, Size frame_size)
+{
+    const Rect FRAME_RECT = Rect(Point(0, 0), frame_size);
+    if (box.empty())
+        return FRAME_RECT;
+
+    return Rect(box.tl() - Point(margin, margin), box.br() + Point(margin, margin)) & FRAME_RECT;
+}
+
 bool playing_field_localizer::is_within_image(const Point &p, int rows, int cols)
 {
     return p.x >= 0 && p.x < cols && p.y >= 0 && p.y < rows;
@@ -248,36 +485,11 @@ void playing_field_localizer::estimate_holes_location(vector<Point> &hole_points
     pair<Point, Point> positive_diagonal = {corners.at(0), corners.at(2)};
     pair<Point, Point> negative_diagonal = {corners.at(1), corners.at(3)};
     Point playing_field_center;
-    bool is_perspective_view = false;
     intersection(positive_diagonal, negative_diagonal, playing_field_center);
 
     // Computation of long and short edges.
     pair<Point, Point> short_edge, long_edge_1, long_edge_2;
-
-    // If the two angular coefficients have similar absolute value and opposite sign, then we have a perspective view
-    const float ANGULAR_COEFFICIENT_EPS = 0.01;
-    if (abs(angular_coefficient(positive_diagonal) + angular_coefficient(negative_diagonal)) < ANGULAR_COEFFICIENT_EPS)
-    {
-        is_perspective_view = true;
-        long_edge_1 = {corners.at(0), corners.at(1)};
-        long_edge_2 = {corners.at(3), corners.at(2)};
-        short_edge = {corners.at(3), corners.at(0)};
-    }
-    else
-    {
-        if (norm(corners.at(0) - corners.at(1)) < norm(corners.at(1) - corners.at(2)))
-        {
-            short_edge = {corners.at(0), corners.at(1)};
-            long_edge_1 = {corners.at(1), corners.at(2)};
-            long_edge_2 = {corners.at(3), corners.at(0)};
-        }
-        else
-        {
-            short_edge = {corners.at(1), corners.at(2)};
-            long_edge_1 = {corners.at(0), corners.at(1)};
-            long_edge_2 = {corners.at(2), corners.at(3)};
-        }
-    }
+    bool is_perspective_view = find_table_edges(corners, false, short_edge, long_edge_1, long_edge_2);
 
     /*
         A line of the same direction of the short edge intersects the two long
@@ -311,9 +523,9 @@ void playing_field_localizer::estimate_holes_location(vector<Point> &hole_points
         The amount is defined by the "adjustment" vars below.
         This is done to better estimate their location.
     */
-    const float LATERAL_HOLES_ADJUSTMENT = 15;
-    const float BOTTOM_CORNERS_ADJUSTMENT = is_perspective_view ? 25 : 10;
-    const float TOP_CORNERS_ADJUSTMENT = is_perspective_view ? 15 : 10;
+    const float LATERAL_HOLES_ADJUSTMENT = 15 * resolution_scale;
+    const float BOTTOM_CORNERS_ADJUSTMENT = (is_perspective_view ? 25 : 10) * resolution_scale;
+    const float TOP_CORNERS_ADJUSTMENT = (is_perspective_view ? 15 : 10) * resolution_scale;
 
     Point2f lateral_hole_1_refined = lateral_hole_1_float + ((playing_field_center_float - lateral_hole_1_float) / norm(playing_field_center_float - lateral_hole_1_float)) * LATERAL_HOLES_ADJUSTMENT;
     Point2f lateral_hole_2_refined = lateral_hole_2_float + ((playing_field_center_float - lateral_hole_2_float) / norm(playing_field_center_float - lateral_hole_2_float)) * LATERAL_HOLES_ADJUSTMENT;
@@ -330,4 +542,228 @@ void playing_field_localizer::estimate_holes_location(vector<Point> &hole_points
     hole_points.push_back(static_cast<Point>(top_right_refined));
     hole_points.push_back(static_cast<Point>(bottom_left_refined));
     hole_points.push_back(static_cast<Point>(bottom_right_refined));
-}
\ No newline at end of file
+}
+
+bool playing_field_localizer::find_table_edges(const vector<Point> &corners, bool is_far_edge_tested, pair<Point, Point> &short_edge, pair<Point, Point> &long_edge_1, pair<Point, Point> &long_edge_2)
+{
+    pair<Point, Point> positive_diagonal = {corners.at(0), corners.at(2)};
+    pair<Point, Point> negative_diagonal = {corners.at(1), corners.at(3)};
+
+    // If the two angular coefficients have similar absolute value and opposite sign, then we have a perspective view
+    const float ANGULAR_COEFFICIENT_EPS = 0.01;
+    bool is_perspective_view = abs(angular_coefficient(positive_diagonal) + angular_coefficient(negative_diagonal)) < ANGULAR_COEFFICIENT_EPS;
+
+    // A far edge much shorter than the near one is a perspective view too, even if it is not centered in the frame,
+    // provided that the lateral edges are long enough to be the long edges of the table. The near edge is the least
+    // foreshortened one, so in a view from the long side of the table the lateral edges are within half of it.
+    const float FAR_EDGE_RATIO = 0.85;
+    const float LATERAL_EDGE_RATIO = 0.5;
+    double far_edge_length = norm(corners.at(1) - corners.at(2));
+    double near_edge_length = norm(corners.at(3) - corners.at(0));
+    double lateral_edge_length = (norm(corners.at(0) - corners.at(1)) + norm(corners.at(3) - corners.at(2))) / 2;
+    if (is_far_edge_tested && far_edge_length < FAR_EDGE_RATIO * near_edge_length && lateral_edge_length > LATERAL_EDGE_RATIO * near_edge_length)
+        is_perspective_view = true;
+
+    if (is_perspective_view)
+    {
+        long_edge_1 = {corners.at(0), corners.at(1)};
+        long_edge_2 = {corners.at(3), corners.at(2)};
+        short_edge = {corners.at(3), corners.at(0)};
+    }
+    else
+    {
+        if (norm(corners.at(0) - corners.at(1)) < norm(corners.at(1) - corners.at(2)))
+        {
+            short_edge = {corners.at(0), corners.at(1)};
+            long_edge_1 = {corners.at(1), corners.at(2)};
+            long_edge_2 = {corners.at(3), corners.at(0)};
+        }
+        else
+        {
+            short_edge = {corners.at(1), corners.at(2)};
+            long_edge_1 = {corners.at(0), corners.at(1)};
+            long_edge_2 = {corners.at(2), corners.at(3)};
+        }
+    }
+
+    return is_perspective_view;
+}
+
+void playing_field_localizer::estimate_table_homography(Mat &table_homography)
+{
+    table_homography.release();
+    const vector<Point> &corners = localization.corners;
+    if (corners.size() != 4)
+        return;
+
+    pair<Point, Point> short_edge, long_edge_1, long_edge_2;
+    find_table_edges(corners, true, short_edge, long_edge_1, long_edge_2);
+    bool is_first_edge_long = long_edge_1.first == corners.at(0);
+
+    // The first corner of a long edge goes in the origin, the others follow clockwise as the corners do
+    const int FIRST_CORNER = is_first_edge_long ? 0 : 1;
+    vector<Point2f> image_points;
+    for (int i = 0; i < corners.size(); i++)
+        image_points.push_back(corners.at((FIRST_CORNER + i) % corners.size()));
+    vector<Point2f> table_points = {Point2f(0, 0), Point2f(CANONICAL_TABLE_LENGTH, 0), Point2f(CANONICAL_TABLE_LENGTH, CANONICAL_TABLE_WIDTH), Point2f(0, CANONICAL_TABLE_WIDTH)};
+    table_homography = getPerspectiveTransform(image_points, table_points);
+}
+
+void playing_field_localizer::estimate_ball_radius_by_row(const Mat &mask, const Rect &table_box, vector<float> &ball_radius_by_row)
+{
+    ball_radius_by_row.clear();
+    const Mat &image_to_table = localization.table_homography;
+    if (image_to_table.empty())
+        return;
+
+    ball_radius_by_row.assign(mask.rows, 0);
+    int first_field_row = -1;
+    for (int row = table_box.y; row < table_box.y + table_box.height; row++)
+    {
+        const uchar *mask_row = mask.ptr<uchar>(row);
+        int first_col = table_box.x, last_col = table_box.x + table_box.width - 1;
+        while (first_col <= last_col && mask_row[first_col] == 0)
+            first_col++;
+        if (first_col > last_col)
+            continue;
+        while (mask_row[last_col] == 0)
+            last_col--;
+
+        // Length on the table of one pixel along the row, in the middle of the playing field
+        float middle_col = (first_col + last_col) / 2.0;
+        vector<Point2f> row_step = {Point2f(middle_col - 0.5, row), Point2f(middle_col + 0.5, row)};
+        perspectiveTransform(row_step, row_step, image_to_table);
+        double step_length = norm(row_step.at(1) - row_step.at(0));
+        if (!(step_length > 0) || !isfinite(step_length))
+            continue;
+
+        ball_radius_by_row.at(row) = CANONICAL_BALL_RADIUS / step_length;
+        if (first_field_row < 0)
+            first_field_row = row;
+    }
+
+    if (first_field_row < 0)
+    {
+        ball_radius_by_row.clear();
+        return;
+    }
+
+    // Rows out of the playing field take the radius of the nearest row of the field
+    for (int row = 0; row < first_field_row; row++)
+        ball_radius_by_row.at(row) = ball_radius_by_row.at(first_field_row);
+    for (int row = first_field_row + 1; row < mask.rows; row++)
+    {
+        if (ball_radius_by_row.at(row) == 0)
+            ball_radius_by_row.at(row) = ball_radius_by_row.at(row - 1);
+    }
+}
+
+void compute_cushion_distance(const Mat &mask, Mat &cushion_distance)
+{
+    if (mask.type() != CV_8UC1)
+    {
+        const string INVALID_MASK = "Argument does not represent a mask.";
+        throw invalid_argument(INVALID_MASK);
+    }
+
+    // Runs reaching the image border are unbounded
+    const ushort UNBOUNDED = numeric_limits<ushort>::max();
+    auto increment = [UNBOUNDED](ushort run)
+    { return run == UNBOUNDED ? UNBOUNDED : static_cast<ushort>(run + 1); };
+
+    cushion_distance.create(mask.size(), CV_16U);
+
+    // Downward pass: left, right and upper runs
+    vector<ushort> above(mask.cols, UNBOUNDED);
+    vector<ushort> right(mask.cols);
+    for (int row = 0; row < mask.rows; row++)
+    {
+        const uchar *mask_row = mask.ptr<uchar>(row);
+        ushort *distance_row = cushion_distance.ptr<ushort>(row);
+
+        ushort run = UNBOUNDED;
+        for (int col = mask.cols - 1; col >= 0; col--)
+        {
+            right[col] = run;
+            run = mask_row[col] != 0 ? increment(run) : 0;
+        }
+
+        ushort left = UNBOUNDED;
+        for (int col = 0; col < mask.cols; col++)
+        {
+            if (mask_row[col] != 0)
+            {
+                distance_row[col] = min(min(left, increment(right[col])), above[col]);
+                left = increment(left);
+                above[col] = increment(above[col]);
+            }
+            else
+            {
+                distance_row[col] = 0;
+                left = 0;
+                above[col] = 0;
+            }
+        }
+    }
+
+    // Upward pass: lower runs
+    vector<ushort> below(mask.cols, UNBOUNDED);
+    for (int row = mask.rows - 1; row >= 0; row--)
+    {
+        const uchar *mask_row = mask.ptr<uchar>(row);
+        ushort *distance_row = cushion_distance.ptr<ushort>(row);
+        for (int col = 0; col < mask.cols; col++)
+        {
+            if (mask_row[col] != 0)
+            {
+                distance_row[col] = min(distance_row[col], increment(below[col]));
+                below[col] = increment(below[col]);
+            }
+            else
+                below[col] = 0;
+        }
+    }
+}
+
+void map_to_source(const playing_field_localization &localization, const frame_resolution &resolution, playing_field_localization &dst)
+{
+    dst = localization;
+    if (resolution.working_size == resolution.source_size)
+        return;
+
+    const double x_factor = static_cast<double>(resolution.source_size.width) / resolution.working_size.width;
+    const double y_factor = static_cast<double>(resolution.source_size.height) / resolution.working_size.height;
+    for (Point &corner : dst.corners)
+        corner = Point(cvRound(corner.x * x_factor), cvRound(corner.y * y_factor));
+    for (Point &hole_point : dst.hole_points)
+        hole_point = Point(cvRound(hole_point.x * x_factor), cvRound(hole_point.y * y_factor));
+
+    dst.table_box = map_box_to_source(localization.table_box, resolution) & Rect(Point(0, 0), resolution.source_size);
+
+    Mat table_mask(resolution.source_size, CV_8U);
+    table_mask.setTo(0);
+    fillConvexPoly(table_mask, dst.corners, 255);
+    dst.mask = table_mask;
+    dst.cushion_distance = Mat();
+    compute_cushion_distance(table_mask, dst.cushion_distance);
+
+    // The homography first moves the source pixels to the working ones
+    if (!localization.table_homography.empty())
+    {
+        Mat source_to_working = Mat::eye(3, 3, CV_64F);
+        source_to_working.at<double>(0, 0) = 1 / x_factor;
+        source_to_working.at<double>(1, 1) = 1 / y_factor;
+        dst.table_homography = localization.table_homography * source_to_working;
+    }
+
+    // Each source row takes the radius of the working row holding it, measured in source pixels
+    if (!localization.ball_radius_by_row.empty())
+    {
+        dst.ball_radius_by_row.resize(resolution.source_size.height);
+        for (int row = 0; row < resolution.source_size.height; row++)
+        {
+            const int working_row = min(static_cast<int>(row / y_factor), static_cast<int>(localization.ball_radius_by_row.size()) - 1);
+            dst.ball_radius_by_row.at(row) = localization.ball_radius_by_row.at(working_row) * x_factor;
+        }
+    }
+}
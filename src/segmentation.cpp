@@ -2,44 +2,260 @@
 
 #include "segmentation.h"
 
+#include <cfloat>
+#include <cmath>
+#include <cstring>
 #include <queue>
 
 using namespace std;
 using namespace cv;
 
-void kmeans(const Mat &src, Mat &dst, int centroids)
+histogram_kmeans::histogram_kmeans(const histogram_kmeans_options &options)
+    : options{options}
 {
-    if (src.empty())
+    if (options.sample_step < 1)
     {
-        const string INVALID_EMPTY_MAT = "Invalid empty mat for kmeans.";
-        throw invalid_argument(INVALID_EMPTY_MAT);
+        const string INVALID_SAMPLE_STEP = "Invalid sample step for histogram kmeans, it must be at least 1.";
+        throw invalid_argument(INVALID_SAMPLE_STEP);
     }
+}
 
-    // data contains dst data (init with src data) used for kmeans clustering (therefore employs 32-bit float values).
-    Mat data;
-    dst.convertTo(data, CV_32F);
-    data = data.reshape(1, data.total());
+void histogram_kmeans::cluster(const Mat &channel_0, const Mat &channel_1, uchar channel_2, Mat &dst, int centroids)
+{
+    if (channel_0.empty() || channel_0.type() != CV_8UC1 || channel_1.type() != CV_8UC1 || channel_0.size() != channel_1.size())
+    {
+        const string INVALID_CHANNELS = "Invalid channels for histogram kmeans, they must be non empty CV_8UC1 mats of the same size.";
+        throw invalid_argument(INVALID_CHANNELS);
+    }
+    if (centroids < 1)
+    {
+        const string INVALID_CENTROIDS = "Invalid number of centroids for histogram kmeans.";
+        throw invalid_argument(INVALID_CENTROIDS);
+    }
+
+    build_histogram(channel_0, channel_1);
+    centroids = min(centroids, static_cast<int>(points.size()));
+
+    // A warm start refines the previous centers, which settle within a few iterations unless the scene changed.
+    // The tolerance is a shift of one bin, finer than the rounding of the centers.
+    const int WARM_MAX_COUNT = 3;
+    const float WARM_TOLERANCE = 1;
+    bool is_warm = false;
+    if (options.warm_start && static_cast<int>(best_centers.size()) == centroids)
+    {
+        centers = best_centers;
+        is_warm = refine_centers(WARM_MAX_COUNT, WARM_TOLERANCE);
+        if (is_warm)
+            best_centers = centers;
+    }
 
-    // Image segmentation is performed via kmeans on the hsv img.
-    Mat labels, centers;
+    // Same attempts and iterations of kmeans, keeping the most compact clustering.
+    // The seeding draws restart from the same seed, so the clustering of a frame does not depend on the frames before.
     const int KMEANS_MAX_COUNT = 10;
-    const int KMEANS_EPSILON = 1.0;
     const int KMEANS_ATTEMPTS = 8;
-    kmeans(data, centroids, labels, TermCriteria(TermCriteria::MAX_ITER, KMEANS_MAX_COUNT, KMEANS_EPSILON), KMEANS_ATTEMPTS, KMEANS_PP_CENTERS, centers);
+    const uint64 RNG_SEED = 0xffffffff;
+    rng = RNG(RNG_SEED);
+    double best_compactness = DBL_MAX;
+    for (int attempt = 0; attempt < KMEANS_ATTEMPTS && !is_warm; attempt++)
+    {
+        seed_centers(centroids);
+        refine_centers(KMEANS_MAX_COUNT, FLT_EPSILON);
+        double compactness = get_compactness();
+        if (compactness < best_compactness)
+        {
+            best_compactness = compactness;
+            best_centers = centers;
+        }
+    }
 
-    // Reshape both to a single row of Vec3f pixels.
-    centers = centers.reshape(3, centers.rows);
-    data = data.reshape(3, data.rows);
+    // Each bin takes its rounded nearest center, as the conversion of the centers to CV_8U would. Every bin is
+    // labeled, since the pixels out of the samples may fall in bins not seen by the clustering.
+    lookup_table.resize(BINS * BINS);
+    for (int bin = 0; bin < BINS * BINS; bin++)
+    {
+        Point2f value(bin / BINS, bin % BINS);
+        float min_distance = FLT_MAX;
+        for (const Point2f &center : best_centers)
+        {
+            Point2f difference = value - center;
+            float distance = difference.dot(difference);
+            if (distance < min_distance)
+            {
+                min_distance = distance;
+                lookup_table[bin] = Vec2b(saturate_cast<uchar>(center.x), saturate_cast<uchar>(center.y));
+            }
+        }
+    }
 
-    // Replace pixel values with their centroids value.
-    for (int i = 0; i < data.rows; i++)
+    dst.create(channel_0.size(), CV_8UC3);
+    for (int row = 0; row < dst.rows; row++)
     {
-        int center_id = labels.at<int>(i);
-        data.at<Vec3f>(i) = centers.at<Vec3f>(center_id);
+        const uchar *row_0 = channel_0.ptr<uchar>(row);
+        const uchar *row_1 = channel_1.ptr<uchar>(row);
+        Vec3b *dst_row = dst.ptr<Vec3b>(row);
+        for (int col = 0; col < dst.cols; col++)
+        {
+            const Vec2b &center = lookup_table[row_0[col] * BINS + row_1[col]];
+            dst_row[col] = Vec3b(center[0], center[1], channel_2);
+        }
     }
+}
 
-    dst = data.reshape(3, dst.rows);
-    dst.convertTo(dst, CV_8U);
+void histogram_kmeans::build_histogram(const Mat &channel_0, const Mat &channel_1)
+{
+    histogram.assign(BINS * BINS, 0);
+    for (int row = 0; row < channel_0.rows; row += options.sample_step)
+    {
+        const uchar *row_0 = channel_0.ptr<uchar>(row);
+        const uchar *row_1 = channel_1.ptr<uchar>(row);
+        for (int col = 0; col < channel_0.cols; col += options.sample_step)
+            histogram[row_0[col] * BINS + row_1[col]]++;
+    }
+
+    points.clear();
+    weights.clear();
+    for (int bin = 0; bin < BINS * BINS; bin++)
+    {
+        if (histogram[bin] == 0)
+            continue;
+        points.push_back(Point2f(bin / BINS, bin % BINS));
+        weights.push_back(histogram[bin]);
+    }
+    distances.resize(points.size());
+    masses.resize(points.size());
+    labels.resize(points.size());
+}
+
+void histogram_kmeans::seed_centers(int centroids)
+{
+    // The first center is drawn with probability proportional to the weight, as a pixel drawn uniformly would.
+    double total_mass = 0;
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        masses[i] = weights[i];
+        total_mass += masses[i];
+    }
+    centers.assign(1, points[sample_point(total_mass)]);
+    total_mass = 0;
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        Point2f difference = points[i] - centers[0];
+        distances[i] = difference.dot(difference);
+        masses[i] = weights[i] * distances[i];
+        total_mass += masses[i];
+    }
+
+    // Each following center is the candidate leaving the least mass, that is the least weighted squared distance.
+    const int SEEDING_TRIALS = 3;
+    for (int k = 1; k < centroids; k++)
+    {
+        int best_candidate = -1;
+        double best_mass = DBL_MAX;
+        for (int trial = 0; trial < SEEDING_TRIALS; trial++)
+        {
+            int candidate = sample_point(total_mass);
+            double candidate_mass = 0;
+            for (size_t i = 0; i < points.size(); i++)
+            {
+                Point2f difference = points[i] - points[candidate];
+                candidate_mass += weights[i] * min(distances[i], difference.dot(difference));
+            }
+            if (candidate_mass < best_mass)
+            {
+                best_mass = candidate_mass;
+                best_candidate = candidate;
+            }
+        }
+
+        centers.push_back(points[best_candidate]);
+        total_mass = 0;
+        for (size_t i = 0; i < points.size(); i++)
+        {
+            Point2f difference = points[i] - points[best_candidate];
+            distances[i] = min(distances[i], difference.dot(difference));
+            masses[i] = weights[i] * distances[i];
+            total_mass += masses[i];
+        }
+    }
+}
+
+bool histogram_kmeans::refine_centers(int iterations, float tolerance)
+{
+    for (int iteration = 0; iteration < iterations; iteration++)
+    {
+        assign_labels();
+
+        sums.assign(centers.size(), Vec2f(0, 0));
+        cluster_weights.assign(centers.size(), 0);
+        for (size_t i = 0; i < points.size(); i++)
+        {
+            sums[labels[i]] += Vec2f(points[i].x, points[i].y) * weights[i];
+            cluster_weights[labels[i]] += weights[i];
+        }
+
+        float max_shift = 0;
+        for (size_t k = 0; k < centers.size(); k++)
+        {
+            Point2f center;
+            if (cluster_weights[k] > 0)
+                center = Point2f(sums[k][0] / cluster_weights[k], sums[k][1] / cluster_weights[k]);
+            else
+            {
+                // An empty cluster takes the point farthest from its center.
+                size_t farthest = max_element(distances.begin(), distances.end()) - distances.begin();
+                center = points[farthest];
+                distances[farthest] = 0;
+            }
+            Point2f shift = center - centers[k];
+            max_shift = max(max_shift, shift.dot(shift));
+            centers[k] = center;
+        }
+
+        if (max_shift <= tolerance)
+            return true;
+    }
+    return false;
+}
+
+double histogram_kmeans::get_compactness()
+{
+    assign_labels();
+    double compactness = 0;
+    for (size_t i = 0; i < points.size(); i++)
+        compactness += weights[i] * distances[i];
+    return compactness;
+}
+
+void histogram_kmeans::assign_labels()
+{
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        float min_distance = FLT_MAX;
+        for (size_t k = 0; k < centers.size(); k++)
+        {
+            Point2f difference = points[i] - centers[k];
+            float distance = difference.dot(difference);
+            if (distance < min_distance)
+            {
+                min_distance = distance;
+                labels[i] = k;
+            }
+        }
+        distances[i] = min_distance;
+    }
+}
+
+int histogram_kmeans::sample_point(double total_mass)
+{
+    double threshold = rng.uniform(0., total_mass);
+    double cumulative_mass = 0;
+    for (size_t i = 0; i < masses.size(); i++)
+    {
+        cumulative_mass += masses[i];
+        if (cumulative_mass > threshold)
+            return i;
+    }
+    return masses.size() - 1;
 }
 
 void region_growing(const Mat &src, Mat &dst, const vector<Point> &seeds, int threshold_0, int threshold_1, int threshold_2)
@@ -92,6 +308,259 @@ void region_growing(const Mat &src, Mat &dst, const vector<Point> &seeds, int th
     }
 }
 
+void scanline_region_grower::grow(const Mat &src, const Mat &seed_mask, Mat &dst, int threshold_0, int threshold_1, int threshold_2)
+{
+    if (src.type() != CV_8UC3)
+    {
+        const string INVALID_SRC = "Invalid mat for region growing, three channels are required.";
+        throw invalid_argument(INVALID_SRC);
+    }
+
+    if (seed_mask.type() != CV_8UC1 || seed_mask.size() != src.size())
+    {
+        const string INVALID_MASK = "Argument does not represent a seed mask.";
+        throw invalid_argument(INVALID_MASK);
+    }
+
+    if (!dst.empty() && dst.data == seed_mask.data)
+    {
+        const string SHARED_DATA = "Seed mask and destination cannot share data.";
+        throw invalid_argument(SHARED_DATA);
+    }
+
+    thresholds[0] = threshold_0;
+    thresholds[1] = threshold_1;
+    thresholds[2] = threshold_2;
+
+    dst.create(src.size(), CV_8UC1);
+    dst.setTo(0);
+    spans.clear();
+
+    // Seeds already reached by the growth of previous seeds need no further visit
+    for (int row = 0; row < src.rows; row++)
+    {
+        const uchar *seed_row = seed_mask.ptr<uchar>(row);
+        const uchar *dst_row = dst.ptr<uchar>(row);
+        for (int col = 0; col < src.cols; col++)
+        {
+            if (seed_row[col] != 0 && dst_row[col] == 0)
+            {
+                fill_span(src, dst, row, col);
+                grow_spans(src, dst);
+            }
+        }
+    }
+}
+
+bool scanline_region_grower::are_similar(const uchar *pixel, const uchar *neighbor) const
+{
+    return abs(pixel[0] - neighbor[0]) <= thresholds[0] &&
+           abs(pixel[1] - neighbor[1]) <= thresholds[1] &&
+           abs(pixel[2] - neighbor[2]) <= thresholds[2];
+}
+
+void scanline_region_grower::fill_span(const Mat &src, Mat &dst, int row, int col)
+{
+    const uchar *src_row = src.ptr<uchar>(row);
+    uchar *dst_row = dst.ptr<uchar>(row);
+    dst_row[col] = 255;
+
+    // Each pixel joins the span if similar to its neighbor already in the span
+    int start = col;
+    while (start > 0 && dst_row[start - 1] == 0 && are_similar(src_row + 3 * (start - 1), src_row + 3 * start))
+        dst_row[--start] = 255;
+
+    int end = col + 1;
+    while (end < src.cols && dst_row[end] == 0 && are_similar(src_row + 3 * end, src_row + 3 * (end - 1)))
+        dst_row[end++] = 255;
+
+    spans.push_back({row, start, end});
+}
+
+void scanline_region_grower::grow_spans(const Mat &src, Mat &dst)
+{
+    while (!spans.empty())
+    {
+        const pixel_span span = spans.back();
+        spans.pop_back();
+
+        const uchar *src_row = src.ptr<uchar>(span.row);
+        for (int neighbor_row : {span.row - 1, span.row + 1})
+        {
+            if (neighbor_row < 0 || neighbor_row >= src.rows)
+                continue;
+
+            const uchar *src_neighbor_row = src.ptr<uchar>(neighbor_row);
+            const uchar *dst_neighbor_row = dst.ptr<uchar>(neighbor_row);
+            for (int col = span.start; col < span.end; col++)
+            {
+                if (dst_neighbor_row[col] == 0 && are_similar(src_neighbor_row + 3 * col, src_row + 3 * col))
+                    fill_span(src, dst, neighbor_row, col);
+            }
+        }
+    }
+}
+
+void parallel_region_grower::grow(const Mat &src, const Mat &seed_mask, Mat &dst, int threshold_0, int threshold_1, int threshold_2)
+{
+    const int strips = min(getNumThreads(), src.rows / MIN_STRIP_ROWS);
+    if (strips <= 1)
+    {
+        serial_grower.grow(src, seed_mask, dst, threshold_0, threshold_1, threshold_2);
+        return;
+    }
+
+    if (src.type() != CV_8UC3)
+    {
+        const string INVALID_SRC = "Invalid mat for region growing, three channels are required.";
+        throw invalid_argument(INVALID_SRC);
+    }
+
+    if (seed_mask.type() != CV_8UC1 || seed_mask.size() != src.size())
+    {
+        const string INVALID_MASK = "Argument does not represent a seed mask.";
+        throw invalid_argument(INVALID_MASK);
+    }
+
+    if (!dst.empty() && dst.data == seed_mask.data)
+    {
+        const string SHARED_DATA = "Seed mask and destination cannot share data.";
+        throw invalid_argument(SHARED_DATA);
+    }
+
+    thresholds[0] = threshold_0;
+    thresholds[1] = threshold_1;
+    thresholds[2] = threshold_2;
+
+    const size_t pixels = src.total();
+    if (pixels > capacity)
+    {
+        parents.reset(new atomic<int>[pixels]);
+        seeded_roots.reset(new atomic<uchar>[pixels]);
+        capacity = pixels;
+    }
+    dst.create(src.size(), CV_8UC1);
+
+    // Independent labeling of each strip
+    parallel_for_(Range(0, strips), [&](const Range &range)
+                  {
+                      for (int strip = range.start; strip < range.end; strip++)
+                          label_strip(src, get_strip_rows(strip, strips, src.rows)); });
+
+    // Merge of the components across the borders between consecutive strips
+    parallel_for_(Range(1, strips), [&](const Range &range)
+                  {
+                      for (int strip = range.start; strip < range.end; strip++)
+                      {
+                          const int row = get_strip_rows(strip, strips, src.rows).start;
+                          const uchar *src_row = src.ptr<uchar>(row);
+                          const uchar *src_upper_row = src.ptr<uchar>(row - 1);
+                          for (int col = 0; col < src.cols; col++)
+                          {
+                              if (are_similar(src_row + 3 * col, src_upper_row + 3 * col))
+                                  unite(row * src.cols + col, (row - 1) * src.cols + col);
+                          }
+                      } });
+
+    // Flag the roots of the components containing a seed
+    parallel_for_(Range(0, strips), [&](const Range &range)
+                  {
+                      for (int strip = range.start; strip < range.end; strip++)
+                      {
+                          const Range rows = get_strip_rows(strip, strips, src.rows);
+                          for (int row = rows.start; row < rows.end; row++)
+                          {
+                              const uchar *seed_row = seed_mask.ptr<uchar>(row);
+                              for (int col = 0; col < src.cols; col++)
+                              {
+                                  if (seed_row[col] != 0)
+                                      seeded_roots[find_root(row * src.cols + col)].store(1, memory_order_relaxed);
+                              }
+                          }
+                      } });
+
+    // The region is made of the seeded components
+    parallel_for_(Range(0, strips), [&](const Range &range)
+                  {
+                      for (int strip = range.start; strip < range.end; strip++)
+                      {
+                          const Range rows = get_strip_rows(strip, strips, src.rows);
+                          for (int row = rows.start; row < rows.end; row++)
+                          {
+                              uchar *dst_row = dst.ptr<uchar>(row);
+                              for (int col = 0; col < src.cols; col++)
+                                  dst_row[col] = seeded_roots[find_root(row * src.cols + col)].load(memory_order_relaxed) != 0 ? 255 : 0;
+                          }
+                      } });
+}
+
+bool parallel_region_grower::are_similar(const uchar *pixel, const uchar *neighbor) const
+{
+    return abs(pixel[0] - neighbor[0]) <= thresholds[0] &&
+           abs(pixel[1] - neighbor[1]) <= thresholds[1] &&
+           abs(pixel[2] - neighbor[2]) <= thresholds[2];
+}
+
+int parallel_region_grower::find_root(int pixel)
+{
+    int parent = parents[pixel].load(memory_order_relaxed);
+    while (parent != pixel)
+    {
+        const int grandparent = parents[parent].load(memory_order_relaxed);
+        parents[pixel].store(grandparent, memory_order_relaxed);
+        pixel = grandparent;
+        parent = parents[pixel].load(memory_order_relaxed);
+    }
+    return pixel;
+}
+
+void parallel_region_grower::unite(int pixel, int neighbor)
+{
+    while (true)
+    {
+        int root = find_root(pixel);
+        int neighbor_root = find_root(neighbor);
+        if (root == neighbor_root)
+            return;
+
+        if (root < neighbor_root)
+            swap(root, neighbor_root);
+
+        // Another thread may have linked the root meanwhile, in that case retry from the new roots
+        int expected = root;
+        if (parents[root].compare_exchange_strong(expected, neighbor_root))
+            return;
+    }
+}
+
+void parallel_region_grower::label_strip(const Mat &src, const Range &rows)
+{
+    for (int row = rows.start; row < rows.end; row++)
+    {
+        const uchar *src_row = src.ptr<uchar>(row);
+        const uchar *src_upper_row = row > rows.start ? src.ptr<uchar>(row - 1) : nullptr;
+        for (int col = 0; col < src.cols; col++)
+        {
+            const int pixel = row * src.cols + col;
+            seeded_roots[pixel].store(0, memory_order_relaxed);
+
+            // Pixels similar to their left neighbor join its run directly
+            if (col > 0 && are_similar(src_row + 3 * col, src_row + 3 * (col - 1)))
+                parents[pixel].store(parents[pixel - 1].load(memory_order_relaxed), memory_order_relaxed);
+            else
+                parents[pixel].store(pixel, memory_order_relaxed);
+
+            if (src_upper_row != nullptr && are_similar(src_row + 3 * col, src_upper_row + 3 * col))
+                unite(pixel, pixel - src.cols);
+        }
+    }
+}
+
+Range parallel_region_grower::get_strip_rows(int strip, int strips, int rows) const
+{
+    return Range(strip * rows / strips, (strip + 1) * rows / strips);
+}
+
 void mask_region_growing(const Mat &src, Mat &dst, const vector<Point> &seeds)
 {
     Mat src_bgr;
@@ -99,46 +568,124 @@ void mask_region_growing(const Mat &src, Mat &dst, const vector<Point> &seeds)
     region_growing(src_bgr, dst, seeds, 0, 0, 0);
 }
 
-Vec3b get_playing_field_color(const Mat &src, float radius)
+Vec3b board_color_estimator::estimate(const Mat &src, const Mat &mask, color_estimate estimate)
 {
-    if (src.empty())
+    is_disk = false;
+    return estimate_region(src, mask, estimate);
+}
+
+Vec3b board_color_estimator::estimate(const Mat &src, Point center, float radius, const Mat &mask, color_estimate estimate)
+{
+    is_disk = true;
+    disk_center = center;
+    disk_radius = radius;
+    return estimate_region(src, mask, estimate);
+}
+
+Vec3b board_color_estimator::estimate_region(const Mat &src, const Mat &mask, color_estimate estimate)
+{
+    if (src.empty() || src.type() != CV_8UC3)
     {
-        const string INVALID_EMPTY_MAT = "Invalid empty mat for getting playing field color.";
-        throw invalid_argument(INVALID_EMPTY_MAT);
+        const string INVALID_SRC = "Invalid image for the board color estimation, it must be a non empty CV_8UC3 mat.";
+        throw invalid_argument(INVALID_SRC);
+    }
+    if (!mask.empty() && (mask.type() != CV_8UC1 || mask.size() != src.size()))
+    {
+        const string INVALID_MASK = "Invalid mask for the board color estimation, it must be a CV_8UC1 mat of the image size.";
+        throw invalid_argument(INVALID_MASK);
     }
 
-    int center_cols = src.cols / 2;
-    int center_rows = src.rows / 2;
-    vector<Vec3b> pixel_values;
+    const bool is_mode = estimate == mode_estimate;
+    if (is_mode)
+        pair_histogram.assign(BINS * BINS, 0);
+    else
+        norm_histogram.assign(NORM_BINS, 0);
 
-    // Collect all pixel values in a radius of value $radius around the image center.
-    for (int row = -radius; row <= radius; ++row)
+    // Rows out of the disk have an empty span, so only the rows of its bounding box are scanned.
+    const int first_row = is_disk ? max(disk_center.y - static_cast<int>(disk_radius), 0) : 0;
+    const int last_row = is_disk ? min(disk_center.y + static_cast<int>(disk_radius), src.rows - 1) : src.rows - 1;
+    int pixels = 0;
+    for (int row = first_row; row <= last_row; row++)
     {
-        for (int col = -radius; col <= radius; ++col)
+        const Range span = get_region_span(row, src.cols);
+        const Vec3b *src_row = src.ptr<Vec3b>(row);
+        const uchar *mask_row = mask.empty() ? nullptr : mask.ptr<uchar>(row);
+        for (int col = span.start; col < span.end; col++)
         {
-            if (col * col + row * row <= radius * radius)
-            {
-                int current_row = center_rows + row;
-                int current_col = center_cols + col;
-
-                if (current_row >= 0 && current_row < src.rows && current_col >= 0 && current_col < src.cols)
-                {
-                    pixel_values.push_back(src.at<Vec3b>(current_row, current_col));
-                }
-            }
+            if (mask_row && !mask_row[col])
+                continue;
+            const Vec3b &pixel = src_row[col];
+            if (is_mode)
+                pair_histogram[pixel[0] * BINS + pixel[1]]++;
+            else
+                norm_histogram[get_squared_norm(pixel)]++;
+            pixels++;
         }
     }
 
-    // Return black if no pixel_values are collected.
-    if (pixel_values.empty())
+    // Return black if no pixel is in the region.
+    if (pixels == 0)
         return Vec3b(0, 0, 0);
 
-    /*
-        Sort by norm. In a grayscale context, we would have just considered the pixel intensity.
-        However, now we have 3 components. So we sort the pixel values triplets by their norm.
-    */
-    sort(pixel_values.begin(), pixel_values.end(), [](const Vec3b &a, const Vec3b &b)
-         { return norm(a) < norm(b); });
+    // The pixels of the estimate are found by a second scan of the region, in the same order of the first one.
+    int squared_norm = 0;
+    Vec3b color;
+    memset(third_histogram, 0, sizeof(third_histogram));
+    if (is_mode)
+    {
+        const int mode_pair = max_element(pair_histogram.begin(), pair_histogram.end()) - pair_histogram.begin();
+        color[0] = mode_pair / BINS;
+        color[1] = mode_pair % BINS;
+    }
+    else
+    {
+        // The median norm is the one of the middle pixel of the region sorted by norm.
+        int cumulative_count = 0;
+        while (cumulative_count + norm_histogram[squared_norm] <= pixels / 2)
+            cumulative_count += norm_histogram[squared_norm++];
+    }
 
-    return pixel_values[pixel_values.size() / 2];
-}
\ No newline at end of file
+    for (int row = first_row; row <= last_row; row++)
+    {
+        const Range span = get_region_span(row, src.cols);
+        const Vec3b *src_row = src.ptr<Vec3b>(row);
+        const uchar *mask_row = mask.empty() ? nullptr : mask.ptr<uchar>(row);
+        for (int col = span.start; col < span.end; col++)
+        {
+            if (mask_row && !mask_row[col])
+                continue;
+            const Vec3b &pixel = src_row[col];
+
+            // The median is the first pixel of the median norm.
+            if (!is_mode && get_squared_norm(pixel) == squared_norm)
+                return pixel;
+            if (is_mode && pixel[0] == color[0] && pixel[1] == color[1])
+                third_histogram[pixel[2]]++;
+        }
+    }
+
+    // The third channel of the mode is the most frequent one among the pixels of the most frequent pair.
+    color[2] = max_element(third_histogram, third_histogram + BINS) - third_histogram;
+    return color;
+}
+
+Range board_color_estimator::get_region_span(int row, int cols) const
+{
+    if (!is_disk)
+        return Range(0, cols);
+
+    // Half width of the disk at the row, the widest one whose columns are within the radius.
+    const int row_offset = row - disk_center.y;
+    const float squared_radius = disk_radius * disk_radius;
+    if (row_offset * row_offset > squared_radius)
+        return Range(0, 0);
+    int half_width = static_cast<int>(sqrt(squared_radius - row_offset * row_offset));
+    while (static_cast<float>((half_width + 1) * (half_width + 1) + row_offset * row_offset) <= squared_radius)
+        half_width++;
+    while (half_width > 0 && static_cast<float>(half_width * half_width + row_offset * row_offset) > squared_radius)
+        half_width--;
+
+    const int start = max(disk_center.x - half_width, 0);
+    const int end = min(disk_center.x + half_width + 1, cols);
+    return start < end ? Range(start, end) : Range(0, 0);
+}
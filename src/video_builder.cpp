@@ -66,12 +66,15 @@ void video_builder::build_output_frames(const string &filename, vector<Mat> &fra
 
     Mat first_frame;
     input_video.read(first_frame);
+    frame_context context(first_frame);
     playing_field_localizer pl_field_loc;
-    pl_field_loc.localize(first_frame);
+    pl_field_loc.localize(context);
 
     balls_localizer balls_loc(pl_field_loc.get_localization());
-    balls_loc.localize(first_frame);
+    balls_loc.localize(context);
 
+    // Tracking and the minimap work on the working frames, the boxes are mapped to the source frames when drawn
+    const frame_resolution resolution = context.get_resolution();
     Ptr<legacy::MultiTracker> multi_tracker = legacy::MultiTracker::create();
 
     // Initialize the trackers for each detected bounding box
@@ -88,11 +91,11 @@ void video_builder::build_output_frames(const string &filename, vector<Mat> &fra
         */
         const float BOUNDING_BOX_RESCALE = 1.3;
         const int MAX_BOUNDING_BOX_SIZE = 30;
-        multi_tracker->add(legacy::TrackerCSRT::create(), first_frame, rescale_bounding_box(bbox, BOUNDING_BOX_RESCALE, MAX_BOUNDING_BOX_SIZE));
+        multi_tracker->add(legacy::TrackerCSRT::create(), context.get_frame(), rescale_bounding_box(bbox, BOUNDING_BOX_RESCALE, get_scaled_length(MAX_BOUNDING_BOX_SIZE, resolution.scale)));
     }
 
     // Set up bounding boxes drawer and first frame
-    bounding_boxes_drawer bboxes_drawer(pl_field_loc.get_localization(), balls_loc.get_localization(), multi_tracker->getObjects());
+    bounding_boxes_drawer bboxes_drawer(pl_field_loc.get_localization(), balls_loc.get_localization(), multi_tracker->getObjects(), resolution);
     Mat bboxes_output_frame;
     bboxes_drawer.draw(first_frame, bboxes_output_frame, multi_tracker->getObjects());
     bboxes_output_frames.push_back(bboxes_output_frame);
@@ -109,7 +112,8 @@ void video_builder::build_output_frames(const string &filename, vector<Mat> &fra
     Mat frame;
     while (input_video.read(frame))
     {
-        multi_tracker->update(frame);
+        context.set_frame(frame);
+        multi_tracker->update(context.get_frame());
         mini.update(multi_tracker->getObjects());
         mini.draw_minimap(pool_table_map);
         bboxes_drawer.draw(frame, bboxes_output_frame, multi_tracker->getObjects());